@@ -0,0 +1,117 @@
+/*
+ * File:   buzzer.c
+ *
+ * Background buzzer patterns on LATA7, played from the 1 ms tick.
+ */
+
+#include <xc.h>
+#include "buzzer.h"
+#include "output.h"
+#include "tick.h"
+
+const Buzzer_Pattern BUZZER_KEY_CLICK = {20, 30, 1};
+const Buzzer_Pattern BUZZER_ABORT     = {100, 0, 1};
+const Buzzer_Pattern BUZZER_EXPIRED   = {250, 250, 4};
+const Buzzer_Pattern BUZZER_ERROR     = {80, 80, 3};
+const Buzzer_Pattern BUZZER_STARTUP   = {500, 500, 2};
+
+static const Buzzer_Pattern *buzzer_queue[BUZZER_QUEUE_DEPTH];
+static volatile unsigned char buzzer_head, buzzer_count;
+
+static const Buzzer_Pattern *volatile buzzer_current;  // NULL when silent
+static volatile unsigned int buzzer_left;               // ms left in this phase
+static volatile unsigned char buzzer_on;                // phase : 1 on, 0 off
+static volatile unsigned char buzzer_repeat;            // on/off pairs left
+
+/*******************************************************************************
+ * Function:        void Buzzer_Init(void)
+ * Description:     Silent buzzer, empty queue
+ * Precondition:    Output_Init called
+ ******************************************************************************/
+void Buzzer_Init(void){
+    Output_Buzzer(0);
+    buzzer_current = 0;
+    buzzer_head = 0;
+    buzzer_count = 0;
+}
+
+/*******************************************************************************
+ * Function:        void Buzzer_Play(const Buzzer_Pattern *pattern)
+ * Description:     Queues a pattern behind the one playing
+ * Precondition:    Buzzer_Init called
+ * Parameters:      pattern = pattern to play
+ * Return Values:   None
+ * Remarks:         A pattern equal to the last queued (or playing) one is
+ *                  dropped, so a held button does not fill the queue.
+ *                  Invalid patterns (see buzzer.h) are not queued.
+ ******************************************************************************/
+void Buzzer_Play(const Buzzer_Pattern *pattern){
+    const Buzzer_Pattern *last;
+
+    if(!pattern->on_ms || !pattern->repeat || (!pattern->off_ms && pattern->repeat > 1))
+        return;                         // would wrap a counter or merge the repeats
+
+    TICK_IE = 0;
+    if(buzzer_count)
+        last = buzzer_queue[(buzzer_head + buzzer_count - 1) % BUZZER_QUEUE_DEPTH];
+    else
+        last = buzzer_current;
+
+    if(pattern != last && buzzer_count < BUZZER_QUEUE_DEPTH){
+        buzzer_queue[(buzzer_head + buzzer_count) % BUZZER_QUEUE_DEPTH] = pattern;
+        buzzer_count++;
+    }
+    TICK_IE = 1;
+}
+
+/*******************************************************************************
+ * Function:        void Buzzer_Stop(void)
+ * Description:     Silences the buzzer and drops every queued pattern
+ ******************************************************************************/
+void Buzzer_Stop(void){
+    TICK_IE = 0;
+    buzzer_current = 0;
+    buzzer_count = 0;
+    Output_Buzzer(0);
+    TICK_IE = 1;
+}
+
+/*******************************************************************************
+ * Function:        void Buzzer_Tick(unsigned char ms)
+ * Description:     Advances the pattern
+ * Precondition:    Called from the interrupt routine on every tick
+ * Parameters:      ms = milliseconds since the last call
+ * Return Values:   None
+ * Remarks:         A phase ends on the first tick at or past its length
+ ******************************************************************************/
+void Buzzer_Tick(unsigned char ms){
+    if(buzzer_current && buzzer_left > ms){
+        buzzer_left -= ms;
+        return;
+    }
+
+    if(buzzer_current && buzzer_on && buzzer_current->off_ms){
+        buzzer_on = 0;                  // on phase done, go quiet
+        buzzer_left = buzzer_current->off_ms;
+        Output_Buzzer(0);
+        return;
+    }
+
+    if(buzzer_current && --buzzer_repeat == 0)
+        buzzer_current = 0;             // pattern finished
+
+    if(!buzzer_current){
+        if(!buzzer_count){
+            Output_Buzzer(0);
+            return;
+        }
+        buzzer_current = buzzer_queue[buzzer_head];
+        buzzer_head = (buzzer_head + 1) % BUZZER_QUEUE_DEPTH;
+        buzzer_count--;
+        buzzer_repeat = buzzer_current->repeat;
+    }
+
+    buzzer_on = 1;
+    buzzer_left = buzzer_current->on_ms;
+    Output_Buzzer(1);
+}
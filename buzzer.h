@@ -0,0 +1,50 @@
+/*
+ * File:   buzzer.h
+ *
+ * Background buzzer patterns, played from the 1 ms tick.
+ * The pin itself belongs to the output manager (output.c).
+ */
+
+#ifndef BUZZER_H
+#define	BUZZER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+#define BUZZER_QUEUE_DEPTH  4           // patterns waiting behind the current one
+
+/*
+ * One pattern : the buzzer is on for on_ms, off for off_ms, and the pair is
+ * played repeat times. RA7 has no CCP output and the fitted buzzer is a
+ * self-oscillating one, so a pattern is timing only.
+ * on_ms and repeat must be at least 1. off_ms may be 0 only for a single
+ * beep (repeat 1) : without a gap the repeats would merge into one tone.
+ * Buzzer_Play ignores patterns breaking these rules.
+ */
+typedef struct {
+    unsigned int on_ms;
+    unsigned int off_ms;
+    unsigned char repeat;
+} Buzzer_Pattern;
+
+extern const Buzzer_Pattern BUZZER_KEY_CLICK;   // short tick on a button press
+extern const Buzzer_Pattern BUZZER_ABORT;       // countdown stopped by the user
+extern const Buzzer_Pattern BUZZER_EXPIRED;     // countdown reached 00:00
+extern const Buzzer_Pattern BUZZER_ERROR;       // fault indication
+extern const Buzzer_Pattern BUZZER_STARTUP;     // power on self test
+
+/*********** P R O T O T Y P E S **********************************************/
+void Buzzer_Init(void);
+void Buzzer_Play(const Buzzer_Pattern *pattern);
+void Buzzer_Stop(void);
+void Buzzer_Tick(unsigned char ms);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* BUZZER_H */
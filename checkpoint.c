@@ -0,0 +1,293 @@
+/*
+ * File:   checkpoint.c
+ *
+ * Power-fail safe countdown progress in data EEPROM.
+ */
+
+#include <xc.h>
+#include "checkpoint.h"
+#include "eeprom.h"
+#include "output.h"
+#include "rtc.h"
+
+/* Countdown position, set by the main loop once per minute */
+static volatile unsigned int ckp_minutes;      // minutes shown, 0 = no countdown
+static volatile unsigned int ckp_minute_end;   // RTC second the shown minute ends
+
+static unsigned int ckp_last;                  // RTC second of the last periodic write
+static unsigned int ckp_hour_start;            // RTC second the budget was refilled
+static volatile unsigned char ckp_budget;      // byte writes left this hour
+static volatile unsigned char ckp_tripped;     // HLVD fired, waiting for the supply to come back
+
+/*******************************************************************************
+ * Function:        static unsigned char Checkpoint_Check(unsigned long rec)
+ * Description:     Check nibble over the low 20 bits of a record
+ ******************************************************************************/
+static unsigned char Checkpoint_Check(unsigned long rec){
+    unsigned char sum = 5, i;
+
+    for(i = 0; i < 5; i++){
+        sum += (unsigned char)rec & 0x0F;
+        rec >>= 4;
+    }
+    return sum & 0x0F;
+}
+
+/*******************************************************************************
+ * Function:        static unsigned char Checkpoint_Write(unsigned char addr, unsigned long rec)
+ * Description:     Adds the check nibble to the low 20 bits and writes a record
+ * Precondition:    None
+ * Parameters:      addr = EE_CHECKPOINT or EE_CHECKPOINT_TOTAL
+ *                  rec = seconds in bits 0..18, flag in bit 19
+ * Return Values:   Number of EEPROM cells written
+ * Remarks:         Unchanged bytes are skipped, so the top byte is rarely
+ *                  written. Safe from the interrupt routine.
+ ******************************************************************************/
+static unsigned char Checkpoint_Write(unsigned char addr, unsigned long rec){
+    unsigned char written;
+
+    rec |= (unsigned long)Checkpoint_Check(rec) << 20;
+
+    written = EEPROM_Update(addr, (unsigned char)rec);
+    written += EEPROM_Update(addr + 1, (unsigned char)(rec >> 8));
+    written += EEPROM_Update(addr + 2, (unsigned char)(rec >> 16));
+    return written;
+}
+
+/*******************************************************************************
+ * Function:        static unsigned char Checkpoint_Read(unsigned char addr, unsigned long *rec)
+ * Description:     Reads a record and tests its check nibble
+ * Precondition:    None
+ * Parameters:      addr = EE_CHECKPOINT or EE_CHECKPOINT_TOTAL
+ *                  rec = receives the low 20 bits
+ * Return Values:   1 if the record is intact
+ * Remarks:         Three EEPROM reads, no delays
+ ******************************************************************************/
+static unsigned char Checkpoint_Read(unsigned char addr, unsigned long *rec){
+    unsigned long r;
+
+    r = (unsigned char)EEPROM_Read(addr);
+    r |= (unsigned long)(unsigned char)EEPROM_Read(addr + 1) << 8;
+    r |= (unsigned long)(unsigned char)EEPROM_Read(addr + 2) << 16;
+
+    *rec = r & 0xFFFFFUL;
+    return (unsigned char)(r >> 20) == Checkpoint_Check(*rec);
+}
+
+/*******************************************************************************
+ * Function:        static unsigned char Checkpoint_Store(unsigned long seconds)
+ * Description:     Writes a progress record with the current relay state
+ * Precondition:    None
+ * Parameters:      seconds = remaining countdown, 0 for none
+ * Return Values:   Number of EEPROM cells written
+ * Remarks:         Safe from the interrupt routine
+ ******************************************************************************/
+static unsigned char Checkpoint_Store(unsigned long seconds){
+    if(seconds > CKP_MAX_SECONDS)
+        seconds = CKP_MAX_SECONDS;
+    if(Output_Relay_State())
+        seconds |= 0x80000UL;
+    return Checkpoint_Write(EE_CHECKPOINT, seconds);
+}
+
+/*******************************************************************************
+ * Function:        unsigned long Checkpoint_Remaining(void)
+ * Description:     Remaining countdown in seconds from the minute position
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   Seconds left, at least 1 while a countdown runs, else 0
+ * Remarks:         None
+ ******************************************************************************/
+unsigned long Checkpoint_Remaining(void){
+    int left = (int)(ckp_minute_end - RTC_Seconds());
+
+    if(ckp_minutes == 0)
+        return 0;
+    if(left < 1)
+        left = 1;
+    return (unsigned long)(ckp_minutes - 1) * 60 + (unsigned int)left;
+}
+
+/*******************************************************************************
+ * Function:        static void Checkpoint_Arm(void)
+ * Description:     Enables the HLVD interrupt, once VDD is above the trip point
+ * Precondition:    HLVDIE cleared by the caller
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         After a trip the detector watches for a rising supply
+ *                  (VDIRMAG = 1), so a stable reference with HLVDIF set
+ *                  means VDD has recovered. Until then the interrupt stays
+ *                  off : a supply hovering at the trip point would
+ *                  otherwise interrupt again as soon as it is enabled.
+ ******************************************************************************/
+static void Checkpoint_Arm(void){
+    if(ckp_tripped){
+        if(!HLVDCONbits.IRVST || !PIR2bits.HLVDIF)
+            return;                     // still below the trip point
+        HLVDCONbits.VDIRMAG = 0;        // watch for the next drop
+        while(!HLVDCONbits.IRVST)
+            ;
+        ckp_tripped = 0;
+    }
+    PIR2bits.HLVDIF = 0;
+    PIE2bits.HLVDIE = 1;
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_Init(void)
+ * Description:     Enables the low voltage detector
+ * Precondition:    RTC_Init called
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         The interrupt itself is only enabled while a countdown runs
+ ******************************************************************************/
+void Checkpoint_Init(void){
+    HLVDCON = CKP_HLVD_LEVEL;           // VDIRMAG = 0 : trip on a falling supply
+    HLVDCONbits.HLVDEN = 1;
+    while(!HLVDCONbits.IRVST)
+        ;                               // reference stable, a few tens of us
+    PIR2bits.HLVDIF = 0;
+
+    ckp_tripped = 0;
+    ckp_budget = CKP_WRITES_PER_HOUR;
+    ckp_hour_start = RTC_Seconds();
+}
+
+/*******************************************************************************
+ * Function:        unsigned long Checkpoint_Load(unsigned char *relay, unsigned long *total)
+ * Description:     Reads the records left by the last power cycle
+ * Precondition:    None, called first thing at boot
+ * Parameters:      relay = receives the saved relay state, may be 0
+ *                  total = receives the length of the whole run, may be 0
+ * Return Values:   Remaining seconds to resume, 0 if nothing to resume
+ * Remarks:         A lost total record gives the remaining time as the total
+ ******************************************************************************/
+unsigned long Checkpoint_Load(unsigned char *relay, unsigned long *total){
+    unsigned long rec, run;
+
+    if(relay)
+        *relay = 0;
+    if(!Checkpoint_Read(EE_CHECKPOINT, &rec))
+        rec = 0;
+
+    if(relay)
+        *relay = (rec & 0x80000UL) ? 1 : 0;
+    rec &= CKP_MAX_SECONDS;
+
+    if(total){
+        if(!Checkpoint_Read(EE_CHECKPOINT_TOTAL, &run) || run < rec)
+            run = rec;
+        *total = run & CKP_MAX_SECONDS;
+    }
+    return rec;
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_Total(unsigned long seconds)
+ * Description:     Records the length of the run about to start
+ * Precondition:    Called before the first Checkpoint_Running of the run
+ * Parameters:      seconds = the whole run, the part before a power cut included
+ * Return Values:   None
+ * Remarks:         A new run finds the progress record clear, so a torn
+ *                  write here leaves nothing to resume. A resumed run
+ *                  writes the same value again, which costs no cell.
+ ******************************************************************************/
+void Checkpoint_Total(unsigned long seconds){
+    if(seconds > CKP_MAX_SECONDS)
+        seconds = CKP_MAX_SECONDS;
+    Checkpoint_Write(EE_CHECKPOINT_TOTAL, seconds);
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_Running(unsigned int minutes, unsigned int minute_end)
+ * Description:     Tells the checkpoint where the countdown is
+ * Precondition:    Checkpoint_Init called
+ * Parameters:      minutes = minutes on the display (the one running included)
+ *                  minute_end = RTC_Seconds() value at which that minute ends
+ * Return Values:   None
+ * Remarks:         The first call of a run writes a checkpoint straight away.
+ *                  Each call arms the HLVD interrupt unless the supply has
+ *                  not come back from a drop yet.
+ ******************************************************************************/
+void Checkpoint_Running(unsigned int minutes, unsigned int minute_end){
+    unsigned char first = (ckp_minutes == 0);
+
+    PIE2bits.HLVDIE = 0;
+    ckp_minutes = minutes;
+    ckp_minute_end = minute_end;
+
+    if(first){
+        Checkpoint_Store(Checkpoint_Remaining());
+        ckp_last = RTC_Seconds();
+    }
+
+    Checkpoint_Arm();
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_Service(void)
+ * Description:     Low rate periodic checkpoint within the write budget
+ * Precondition:    Called from the countdown loop while the displays are dark
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         Also re-arms the HLVD interrupt once the supply is back
+ *                  from a drop the board survived
+ ******************************************************************************/
+void Checkpoint_Service(void){
+    unsigned int now = RTC_Seconds();
+
+    if((unsigned int)(now - ckp_hour_start) >= 3600){
+        ckp_hour_start = now;
+        ckp_budget = CKP_WRITES_PER_HOUR;
+    }
+
+    if(ckp_tripped && ckp_minutes)
+        Checkpoint_Arm();
+
+    if(ckp_minutes == 0 || (unsigned int)(now - ckp_last) < CKP_PERIOD_S)
+        return;
+    if(ckp_budget < 2 * CKP_RECORD_WRITES)
+        return;                         // keep a record for a supply drop
+
+    ckp_last = now;
+    PIE2bits.HLVDIE = 0;
+    ckp_budget -= Checkpoint_Store(Checkpoint_Remaining());
+    Checkpoint_Arm();
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_Clear(void)
+ * Description:     Marks the countdown as finished, nothing to resume
+ ******************************************************************************/
+void Checkpoint_Clear(void){
+    PIE2bits.HLVDIE = 0;
+    ckp_minutes = 0;
+    Checkpoint_Store(0);
+}
+
+/*******************************************************************************
+ * Function:        void Checkpoint_ISR(void)
+ * Description:     Saves the exact remaining time on a supply drop
+ * Precondition:    Called from the interrupt routine when HLVDIF is set
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         The EEPROM address and data registers of an interrupted
+ *                  read or write are put back. One record per drop, within
+ *                  the hourly write budget like the periodic record. The
+ *                  detector then waits for the supply to rise again, and
+ *                  the interrupt is re-armed once it has.
+ ******************************************************************************/
+void Checkpoint_ISR(void){
+    unsigned char adr = EEADR, dat = EEDATA, wren = EECON1bits.WREN;
+
+    PIE2bits.HLVDIE = 0;
+    if(ckp_budget >= CKP_RECORD_WRITES)
+        ckp_budget -= Checkpoint_Store(Checkpoint_Remaining());
+    HLVDCONbits.VDIRMAG = 1;            // HLVDIF now reports VDD back above the trip point
+    PIR2bits.HLVDIF = 0;
+    ckp_tripped = 1;
+
+    EEADR = adr;
+    EEDATA = dat;
+    EECON1bits.WREN = wren;
+}
@@ -0,0 +1,63 @@
+/*
+ * File:   checkpoint.h
+ *
+ * Power-fail safe countdown progress in data EEPROM.
+ */
+
+#ifndef CHECKPOINT_H
+#define	CHECKPOINT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+/*
+ * The HLVD module interrupts when VDD falls below the trip point, and the
+ * remaining time is written while the supply capacitors still hold the PIC
+ * up (3 bytes, at most 12 ms). Level 0b1101 trips near 4.3 V on the 5 V
+ * board, well above the brown-out reset.
+ */
+#ifndef CKP_HLVD_LEVEL
+#define CKP_HLVD_LEVEL      0b1101
+#endif
+
+/*
+ * Periodic checkpoint for a supply that vanishes too fast for HLVD. Every
+ * CKP_PERIOD_S seconds at most, and never more than CKP_WRITES_PER_HOUR
+ * byte writes per hour, so the three cells see about 100 writes a day of
+ * continuous running instead of one a second. HLVD records are paid from
+ * the same budget, and the periodic record always leaves one record's
+ * worth (CKP_RECORD_WRITES) for the next supply drop.
+ */
+#define CKP_PERIOD_S        300
+#define CKP_WRITES_PER_HOUR 12
+#define CKP_RECORD_WRITES   3           // cells a record can cost
+
+#define CKP_MAX_SECONDS     0x7FFFFUL   // 19 bits, 99:59 is 359940 s
+
+/*
+ * Record : bits 0..18 remaining seconds, bit 19 relay, bits 20..23 check
+ * nibble. A torn or erased record fails the check and is ignored; zero
+ * seconds means no countdown was running. The total record next to it has
+ * the same layout with the length of the whole run and bit 19 clear, so a
+ * resumed run still shows and logs its progress against the full length.
+ */
+
+/*********** P R O T O T Y P E S **********************************************/
+void Checkpoint_Init(void);
+unsigned long Checkpoint_Load(unsigned char *relay, unsigned long *total);
+void Checkpoint_Total(unsigned long seconds);
+void Checkpoint_Running(unsigned int minutes, unsigned int minute_end);
+void Checkpoint_Service(void);
+unsigned long Checkpoint_Remaining(void);
+void Checkpoint_Clear(void);
+void Checkpoint_ISR(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CHECKPOINT_H */
@@ -0,0 +1,120 @@
+/*
+ * File:   clock.c
+ *
+ * Run time clock scaling and delays that follow the clock.
+ */
+
+#include <xc.h>
+#include "clock.h"
+#include "tick.h"
+#include "i2c.h"
+
+typedef struct {
+    unsigned char osccon;               // IRCF, SCS = 00
+    unsigned char osctune;              // INTSRC | PLLEN
+    unsigned char t3con;                // delay time base
+    unsigned char t2con;                // 250 kHz Timer2 for the 7 segment scan, TMR2ON left out
+    unsigned char t4con;                // Timer4 prescaler for the tick, TMR4ON set
+    unsigned char tick_us;              // Timer4 microseconds per count at that prescaler
+    unsigned long hz;
+} Clock_Mode;
+
+static const Clock_Mode clock_mode[CLOCK_SPEEDS] = {
+    {0x70, 0xC0, 0b00110011, 0b00011010, 0b00000110, 1,  64000000UL},  // FOSC/4 1:8,  16 MHz / 16 post 1:4,  16 MHz / 16
+    {0x70, 0x80, 0b00010011, 0b00000010, 0b00000110, 4,  16000000UL},  // FOSC/4 1:2,  4 MHz / 16,          4 MHz / 16
+    {0x30, 0x80, 0b00000011, 0b00000000, 0b00000101, 16, 1000000UL},   // no prescale, 250 kHz,             250 kHz / 4
+};
+
+static unsigned char clock_speed = 0xFF;    // nothing set yet
+
+/*******************************************************************************
+ * Function:        void Clock_Set(unsigned char speed)
+ * Description:     Switches the CPU clock and rescales everything timed by it
+ * Precondition:    No I2C transfer running (main loop context)
+ * Parameters:      speed = CLOCK_64MHZ, CLOCK_16MHZ or CLOCK_1MHZ
+ * Return Values:   None
+ * Remarks:         Timer4 (1 ms tick), Timer2 (7 segment scan), Timer3
+ *                  (Delay_us) and the I2C baud reload of every bus are
+ *                  recomputed. Costs nothing when the speed is already set.
+ ******************************************************************************/
+void Clock_Set(unsigned char speed){
+    const Clock_Mode *mode;
+
+    if(speed == clock_speed || speed >= CLOCK_SPEEDS)
+        return;
+    mode = &clock_mode[speed];
+
+    if(!(mode->osctune & 0x40))
+        OSCTUNE = mode->osctune;        // PLL off before the postscaler drops
+    OSCCON = mode->osccon;
+    while(!OSCCONbits.HFIOFS)
+        ;
+    if(mode->osctune & 0x40){
+        OSCTUNE = mode->osctune;
+        while(!OSCCON2bits.PLLRDY)
+            ;
+    }
+
+    T3CON = mode->t3con;
+    T2CON = mode->t2con | (T2CON & 0x04); // keep TMR2ON, the scan owns it
+    Tick_Rate(mode->t4con, mode->tick_us);
+    clock_speed = speed;
+
+    I2C_Set_Speed(&I2C_BUS2, mode->hz);
+#if I2C_BUS1_ENABLE
+    I2C_Set_Speed(&I2C_BUS1, mode->hz);
+#endif
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Clock_Get(void)
+ * Description:     Current speed, CLOCK_64MHZ .. CLOCK_1MHZ
+ ******************************************************************************/
+unsigned char Clock_Get(void){
+    return clock_speed;
+}
+
+/*******************************************************************************
+ * Function:        unsigned long Clock_Hz(void)
+ * Description:     Current FOSC in Hz
+ ******************************************************************************/
+unsigned long Clock_Hz(void){
+    return clock_mode[clock_speed < CLOCK_SPEEDS ? clock_speed : CLOCK_64MHZ].hz;
+}
+
+/*******************************************************************************
+ * Function:        void Delay_ms(unsigned int ms)
+ * Description:     Waits at least ms milliseconds
+ * Precondition:    Tick_Init called and interrupts enabled
+ * Parameters:      ms = delay, below 32768
+ * Return Values:   None
+ * Remarks:         Counted on the 1 ms tick, so right at every clock speed
+ ******************************************************************************/
+void Delay_ms(unsigned int ms){
+    unsigned int start = Tick_Get();
+
+    while((unsigned int)(Tick_Get() - start) <= ms)
+        ;
+}
+
+/*******************************************************************************
+ * Function:        void Delay_us(unsigned int us)
+ * Description:     Waits at least us microseconds
+ * Precondition:    Clock_Set called
+ * Parameters:      us = delay, below 32768
+ * Return Values:   None
+ * Remarks:         Counted on Timer3. At 1 MHz one instruction is 4 us, so
+ *                  short delays come out longer than asked.
+ ******************************************************************************/
+void Delay_us(unsigned int us){
+    unsigned int start = TMR3;
+    unsigned int counts;
+
+    if(clock_speed == CLOCK_1MHZ)
+        counts = (us + 3) >> 2;
+    else
+        counts = us << 1;
+
+    while((unsigned int)(TMR3 - start) < counts)
+        ;
+}
@@ -0,0 +1,55 @@
+/*
+ * File:   clock.h
+ *
+ * Run time clock scaling and delays that follow the clock.
+ * Kept apart from config.h so the #pragma config bits are only seen by main.c.
+ */
+
+#ifndef CLOCK_H
+#define	CLOCK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** S P E E D S ******************************************************/
+/*
+ * All three come from HFINTOSC, so moving between 16 and 1 MHz is only a
+ * postscaler change. 64 MHz adds the 4x PLL (PLLCFG = OFF in config.h so
+ * PLLEN is ours) and waits up to 2 ms for it to lock.
+ */
+#define CLOCK_64MHZ     0               // HFINTOSC 16 MHz x 4 PLL
+#define CLOCK_16MHZ     1               // HFINTOSC 16 MHz
+#define CLOCK_1MHZ      2               // HFINTOSC 1 MHz
+#define CLOCK_SPEEDS    3
+
+/* Policy used by main.c */
+#ifndef CLOCK_BURST
+#define CLOCK_BURST     CLOCK_64MHZ     // LCD / I2C / EEPROM work
+#endif
+#define CLOCK_RUN       CLOCK_16MHZ     // countdown, stopwatch, edit mode
+#define CLOCK_IDLE      CLOCK_1MHZ      // waiting for a button
+
+/*
+ * Timer2 (7 segment scan) keeps a 250 kHz count : at 64 MHz it counts at
+ * 1 MHz and the 1:4 postscaler brings the match rate back, so the scan
+ * timing holds at every speed. Timer4 (tick) is rescaled by Tick_Rate, with
+ * a 4 ms period at 1 MHz (see tick.h). Timer0 is free.
+ * Timer3 runs free from FOSC/4 as the microsecond delay base : 0.5 us per
+ * count at 64 and 16 MHz, 4 us at 1 MHz.
+ */
+
+/*********** P R O T O T Y P E S **********************************************/
+void Clock_Set(unsigned char speed);
+unsigned char Clock_Get(void);
+unsigned long Clock_Hz(void);
+void Delay_ms(unsigned int ms);
+void Delay_us(unsigned int us);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CLOCK_H */
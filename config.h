@@ -2,7 +2,7 @@
     #define	CONFIG_H
 // CONFIG1H
 #pragma config FOSC = INTIO67   // Oscillator Selection bits (Internal oscillator block)
-#pragma config PLLCFG = ON      // 4X PLL Enable (Oscillator multiplied by 4)
+#pragma config PLLCFG = OFF     // 4X PLL Enable (PLL under software control, see clock.c)
 #pragma config PRICLKEN = ON    // Primary clock enable bit (Primary clock enabled)
 #pragma config FCMEN = OFF      // Fail-Safe Clock Monitor Enable bit (Fail-Safe Clock Monitor disabled)
 #pragma config IESO = OFF       // Internal/External Oscillator Switchover bit (Oscillator Switchover mode disabled)
@@ -65,7 +65,4 @@
 
 //#include <xc.h>
 
-    //Define the Fosc
-    #define _XTAL_FREQ 64000000
-    
 #endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+/*
+ * File:   eeprom.c
+ *
+ * Data EEPROM access.
+ * Split out of main.c, 10-06-2023 by Aditya Chaudhary <ac3101282@gmail.com>
+ */
+
+#include <xc.h>
+#include "eeprom.h"
+
+/*
+ * @desc: write data to eeprom.
+ * @params : address, data.
+ * @return : none.
+ */
+
+void EEPROM_Write(unsigned char address, unsigned char data)
+{
+    unsigned char gie = INTCONbits.GIE; /* 0 when called from the interrupt routine */
+
+    while (EECON1bits.WR)
+        ;                 /* Wait for a write that was interrupted */
+
+    /*Write Operation*/
+    INTCONbits.GIE = 0;   /* Disable global interrupt*/
+    EEADR = address;      /* Write address to the EEADR register*/
+    EEDATA = data;        /* Copy data to the EEDATA register for write */
+    EECON1bits.EEPGD = 0; /* Access data EEPROM memory*/
+    EECON1bits.CFGS = 0;  /* Access flash program or data memory*/
+    EECON1bits.WREN = 1;  /* Allow write to the memory*/
+
+    /* Below sequence in EECON2 Register is necessary
+    to write data to EEPROM memory*/
+    EECON2 = 0x55;
+    EECON2 = 0xAA;
+
+    EECON1bits.WR = 1;    /* Start writing data to EEPROM memory*/
+    INTCONbits.GIE = gie; /* Restore interrupt*/
+
+    while (EECON1bits.WR)
+        ;              /* Wait for write operation complete */
+    PIR2bits.EEIF = 0; /* Reset EEIF for further write operation */
+}
+
+/*
+ *@desc : read data from eeprom.
+ *@params : address
+ *@return : data
+ *@return_type : char
+ */
+
+char EEPROM_Read(unsigned char address)
+{
+    /*Read operation*/
+    EEADR = address;      /* Read data at location 0x00*/
+    EECON1bits.WREN = 0;  /* WREN bit is clear for Read operation*/
+    EECON1bits.EEPGD = 0; /* Access data EEPROM memory*/
+    EECON1bits.RD = 1;    /* To Read data of EEPROM memory set RD=1*/
+    return (EEDATA);
+}
+
+/*
+ * @desc : write a byte only when the cell holds something else.
+ *         Saves the 4 ms write time and a write cycle of endurance.
+ * @params : address, data.
+ * @return : 1 if the cell was written.
+ */
+unsigned char EEPROM_Update(unsigned char address, unsigned char data)
+{
+    if ((unsigned char)EEPROM_Read(address) == data)
+        return 0;
+    EEPROM_Write(address, data);
+    return 1;
+}
@@ -0,0 +1,41 @@
+/*
+ * File:   eeprom.h
+ *
+ * Data EEPROM access and the address map of everything kept in it.
+ */
+
+#ifndef EEPROM_H
+#define	EEPROM_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** A D D R E S S   M A P ********************************************/
+#define EE_HOUR_FIRST       0x0A        // countdown digits H1 H2 M1 M2
+#define EE_HOUR_SECOND      0x0B
+#define EE_MINUTE_FIRST     0x0C
+#define EE_MINUTE_SECOND    0x0D
+#define EE_INIT_FLAG        0x0F        // 1 once the digits have been initialised
+#define EE_LCD_ADDR         0x10        // cached LCD backpack address
+#define EE_CHECKPOINT       0x11        // 3 bytes, countdown progress (checkpoint.c)
+#define EE_CHECKPOINT_TOTAL 0x14        // 3 bytes, length of that countdown
+
+#define EE_LAP_COUNT        0x20        // laps stored below, newest last
+#define EE_LAP_TOTAL        0x21        // laps taken in the stored run
+#define EE_LAP_BASE         0x22        // 4 bytes per lap, little endian ms
+
+#define EE_LOG_BASE         0x80        // run log to the end of the EEPROM (runlog.c)
+
+/*********** P R O T O T Y P E S **********************************************/
+void EEPROM_Write(unsigned char address, unsigned char data);
+char EEPROM_Read(unsigned char address);
+unsigned char EEPROM_Update(unsigned char address, unsigned char data);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* EEPROM_H */
@@ -8,24 +8,70 @@
 
 #include <xc.h>
 #include "i2c.h"
+#include "clock.h"
+
+/*********** B U S   H A N D L E S ********************************************/
+static volatile unsigned char i2c_bus2_open, i2c_bus2_lent;
+
+const I2C_Bus I2C_BUS2 = {
+    &SSP2CON1, &SSP2CON2, &SSP2STAT, &SSP2ADD, &SSP2BUF,
+    &PIR3, 0x80,                    // PIR3<7> = SSP2IF
+    &TRISB, &ANSELB, &LATB,
+    0x06, 0x02,                     // RB1 = SCL2, RB2 = SDA2
+    &i2c_bus2_open, &i2c_bus2_lent
+};
+
+#if I2C_BUS1_ENABLE
+static volatile unsigned char i2c_bus1_open, i2c_bus1_lent;
+
+const I2C_Bus I2C_BUS1 = {
+    &SSP1CON1, &SSP1CON2, &SSP1STAT, &SSP1ADD, &SSP1BUF,
+    &PIR1, 0x08,                    // PIR1<3> = SSP1IF
+    &TRISC, &ANSELC, &LATC,
+    0x18, 0x08,                     // RC3 = SCL1, RC4 = SDA1
+    &i2c_bus1_open, &i2c_bus1_lent
+};
+#endif
+
+#define I2C_SSPEN   0x20            // SSPxCON1<5>
+
+#if I2C_TRACE
+static I2C_Trace_Record i2c_trace[I2C_TRACE_DEPTH];
+static unsigned char i2c_trace_head;    // next record to write
+static unsigned char i2c_trace_count;   // valid records, saturates at depth
+static unsigned char i2c_trace_addr;    // address of the running transaction
+static unsigned char i2c_trace_start;   // next byte is an address byte
+#endif
+
+/*******************************************************************************
+ * Function:        static void I2C_Wait(const I2C_Bus *bus)
+ * Description:     Waits for the current bus event and clears SSPxIF
+ * Precondition:    A start/stop/ack/transfer has been triggered on the bus
+ * Parameters:      bus = MSSP bus handle
+ * Return Values:   None
+ * Remarks:         Host builds play the event on the simulated bus first
+ ******************************************************************************/
+static void I2C_Wait(const I2C_Bus *bus){
+#ifdef I2C_HOST
+    I2C_Host_Event(bus);
+#endif
+	while(!(*bus->pir & bus->if_mask));
+	*bus->pir &= (unsigned char)~bus->if_mask;
+}
 
 /*******************************************************************************
- * Function:        void I2C2_Init(void)
+ * Function:        void I2C_Init(const I2C_Bus *bus)
  * Description:     Configure I2C module
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
  * Remarks:         None
  ******************************************************************************/
-void I2C2_Init(void){	
-    SDA2_DIR = I2C_INPUT;        
-    SCK2_DIR = I2C_INPUT;	
-    
-    
-    ANSELBbits.ANSB2 = 0; //configure the input pin RB2 as digital (very important)
-    ANSELBbits.ANSB1 = 0; //configure the input pin RB1 as digital (very important)
-    
-    SSP2STAT = 0b10000000;		// Slew Rate control is disabled
+void I2C_Init(const I2C_Bus *bus){
+    *bus->tris |= bus->pin_mask;        // SCL and SDA as inputs
+    *bus->ansel &= (unsigned char)~bus->pin_mask; // configure SCL and SDA as digital (very important)
+
+    *bus->stat = 0b10000000;		// Slew Rate control is disabled
      /*
    * WCOL:0
    * SSPOV:0
@@ -33,120 +79,448 @@ void I2C2_Init(void){
    * CKP:0
    * SSPM3:SSPM0:1000 -> I2C Master Mode, clock=FOSC/(4*(SSPADD+1))
    * FOSC = 64MHZ, and to get a clock of 100Khz => SSPADD = 159u
-   */	
-	SSP2CON1 = 0b00101000;		// Select and enable I2C in master mode
-    SSP2ADD  = 159u; //((_XTAL_FREQ/4000)/I2C_SPEED) - 1;	
+   */
+	*bus->con1 = 0b00101000;		// Select and enable I2C in master mode
+    I2C_Set_Speed(bus, Clock_Hz());
+}
+
+
+/*******************************************************************************
+ * Function:        void I2C_Set_Speed(const I2C_Bus *bus, unsigned long FOSC)
+ * Description:     Reloads the baud rate generator for I2C_SPEED
+ * Precondition:    Bus idle
+ * Parameters:      bus = MSSP bus handle, FOSC = CPU clock in Hz
+ * Return Values:   None
+ * Remarks:         SSPxADD below 3 is not supported by the MSSP, so at
+ *                  1 MHz the bus runs at 62.5 kHz instead of 100 kHz
+ ******************************************************************************/
+void I2C_Set_Speed(const I2C_Bus *bus, unsigned long FOSC){
+    unsigned long reload = FOSC / (4000UL * I2C_SPEED) - 1;
+
+    *bus->add = reload < 3 ? 3 : (unsigned char)reload;   // 159 at 64 MHz, 39 at 16 MHz
 }
 
 
 
 /*******************************************************************************
- * Function:        void I2C_Start(void)
+ * Function:        void I2C_Start(const I2C_Bus *bus)
  * Description:     Sends start bit sequence
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
- * Remarks:         None
+ * Remarks:         Re-enables the MSSP when I2C_Pins_Take lent the pins out,
+ *                  after waiting for I2C_Pins_Release
  ******************************************************************************/
-void I2C2_Start(void){
-	SSP2CON2bits.SEN = I2C_HIGH;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;	
+void I2C_Start(const I2C_Bus *bus){
+    *bus->open = 1;                     // first : I2C_Pins_Take now leaves the pins alone
+    while(*bus->lent){                  // the borrower still drives them
+#ifdef I2C_HOST
+        I2C_Host_Idle();
+#endif
+    }
+    if(!(*bus->con1 & I2C_SSPEN)){      // pins were lent out, walk them back to idle
+        *bus->lat &= (unsigned char)~bus->scl_mask;
+        *bus->lat |= bus->pin_mask & (unsigned char)~bus->scl_mask;
+        *bus->lat |= bus->scl_mask;     // SDA high before SCL high : no start, no stop
+        *bus->tris |= bus->pin_mask;
+        *bus->con1 |= I2C_SSPEN;
+    }
+	*bus->con2 |= I2C_SEN;
+	I2C_Wait(bus);
+#if I2C_TRACE
+    i2c_trace_start = 1;
+#endif
 }
 
 
 
 /*******************************************************************************
- * Function:        void I2C_ReStart(void)
+ * Function:        void I2C_ReStart(const I2C_Bus *bus)
  * Description:     Sends restart bit sequence
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
  * Remarks:         None
  ******************************************************************************/
-void I2C2_ReStart(void){
-	SSP2CON2bits.RSEN = I2C_HIGH;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;			
+void I2C_ReStart(const I2C_Bus *bus){
+	*bus->con2 |= I2C_RSEN;
+	I2C_Wait(bus);
+#if I2C_TRACE
+    i2c_trace_start = 1;
+#endif
 }
 
 
 /*******************************************************************************
- * Function:        void I2C_Stop(void)
+ * Function:        void I2C_Stop(const I2C_Bus *bus)
  * Description:     Sends stop bit sequence
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
  * Remarks:         None
  ******************************************************************************/
-void I2C2_Stop(void){
-	SSP2CON2bits.PEN = 1;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = 0;				
+void I2C_Stop(const I2C_Bus *bus){
+	*bus->con2 |= I2C_PEN;
+	I2C_Wait(bus);
+    *bus->open = 0;
 }
 
 
 
 /*******************************************************************************
- * Function:        void I2C_Send_ACK(void)
+ * Function:        void I2C_Send_ACK(const I2C_Bus *bus)
  * Description:     Sends ACK bit sequence
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
  * Remarks:         None
  ******************************************************************************/
-void I2C2_Send_ACK(void){
-	SSP2CON2bits.ACKDT = I2C_LOW;			
-	SSP2CON2bits.ACKEN = I2C_HIGH;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;			
+void I2C_Send_ACK(const I2C_Bus *bus){
+	*bus->con2 &= (unsigned char)~I2C_ACKDT;
+	*bus->con2 |= I2C_ACKEN;
+	I2C_Wait(bus);
 }
 
 
 /*******************************************************************************
- * Function:        void I2C_Send_NACK(void)
+ * Function:        void I2C_Send_NACK(const I2C_Bus *bus)
  * Description:     Sends NACK bit sequence
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   None
  * Remarks:         None
  ******************************************************************************/
-void I2C2_Send_NACK(void){
-	SSP2CON2bits.ACKDT = I2C_HIGH;			
-	SSP2CON2bits.ACKEN = I2C_HIGH;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;	
+void I2C_Send_NACK(const I2C_Bus *bus){
+	*bus->con2 |= I2C_ACKDT;
+	*bus->con2 |= I2C_ACKEN;
+	I2C_Wait(bus);
 }
 
 
 
 /*******************************************************************************
- * Function:        unsigned char I2C_Write(unsigned char BYTE)
+ * Function:        unsigned char I2C_Send(const I2C_Bus *bus, unsigned char BYTE)
  * Description:     Transfers one byte
  * Precondition:    None
- * Parameters:      BYTE = Value for slave device
+ * Parameters:      bus = MSSP bus handle, BYTE = Value for slave device
  * Return Values:   Return ACK/NACK from slave
  * Remarks:         None
  ******************************************************************************/
-unsigned char I2C2_Send(unsigned char BYTE){
-	SSP2BUF = BYTE;                 
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;			
-	return SSP2CON2bits.ACKSTAT;    
+unsigned char I2C_Send(const I2C_Bus *bus, unsigned char BYTE){
+	*bus->buf = BYTE;
+	I2C_Wait(bus);
+#if I2C_TRACE
+    {
+        I2C_Trace_Record *rec = &i2c_trace[i2c_trace_head];
+
+        rec->time = TMR1;
+        if(i2c_trace_start){
+            i2c_trace_addr = BYTE;
+            i2c_trace_start = 0;
+            rec->flags = I2C_TRACE_ADDR;
+        }else{
+            rec->flags = 0;
+        }
+        if(*bus->con2 & I2C_ACKSTAT)
+            rec->flags |= I2C_TRACE_NACK;
+        rec->addr = i2c_trace_addr;
+        rec->data = BYTE;
+
+        i2c_trace_head = (i2c_trace_head + 1) & (I2C_TRACE_DEPTH - 1);
+        if(i2c_trace_count < I2C_TRACE_DEPTH)
+            i2c_trace_count++;
+    }
+#endif
+	return (*bus->con2 & I2C_ACKSTAT) ? 1 : 0;
 }
 
 
 /*******************************************************************************
- * Function:        unsigned char I2C_Read(void)
+ * Function:        unsigned char I2C_Read(const I2C_Bus *bus)
  * Description:     Reads one byte
  * Precondition:    None
- * Parameters:      None
+ * Parameters:      bus = MSSP bus handle
  * Return Values:   Return received byte
  * Remarks:         None
  ******************************************************************************/
-unsigned char I2C2_Read(void){
-	SSP2CON2bits.RCEN = I2C_HIGH;			
-	while(!PIR3bits.SSP2IF);		
-	PIR3bits.SSP2IF = I2C_LOW;			
-    return SSP2BUF;      
-}
\ No newline at end of file
+unsigned char I2C_Read(const I2C_Bus *bus){
+	*bus->con2 |= I2C_RCEN;
+	I2C_Wait(bus);
+    return *bus->buf;
+}
+
+
+/*******************************************************************************
+ * Function:        static void I2C_Read_Bytes(const I2C_Bus *bus,
+ *                                            unsigned char *buf, unsigned char len)
+ * Description:     Clocks in len bytes, ACK after each but the last, NACK after it
+ * Precondition:    Read address sent and acknowledged, len > 0
+ * Parameters:      bus = MSSP bus handle, buf = destination, len = byte count
+ * Return Values:   None
+ * Remarks:         Callers check len before sending the read address
+ ******************************************************************************/
+static void I2C_Read_Bytes(const I2C_Bus *bus, unsigned char *buf, unsigned char len){
+    while(len){
+        *bus->con2 |= I2C_RCEN;
+        I2C_Wait(bus);
+        *buf++ = *bus->buf;
+        if(--len)
+            *bus->con2 &= (unsigned char)~I2C_ACKDT;   // more to come : ACK
+        else
+            *bus->con2 |= I2C_ACKDT;                    // last byte : NACK
+        *bus->con2 |= I2C_ACKEN;
+        I2C_Wait(bus);
+    }
+}
+
+
+/*******************************************************************************
+ * Function:        unsigned char I2C_Read_Block(const I2C_Bus *bus, unsigned char ADDR,
+ *                                               unsigned char *buf, unsigned char len)
+ * Description:     Reads len bytes from a device in one transaction
+ * Precondition:    I2C_Init called for the bus
+ * Parameters:      bus = MSSP bus handle, ADDR = 8-bit write address,
+ *                  buf = destination, len = byte count
+ * Return Values:   1 on success, 0 if the device did not acknowledge or len = 0
+ * Remarks:         START, read address, len bytes, STOP. buf is not touched
+ *                  when the device is absent. len = 0 is refused before the
+ *                  START : an acknowledged read address with no byte clocked
+ *                  leaves the slave driving SDA, and the STOP would not take
+ ******************************************************************************/
+unsigned char I2C_Read_Block(const I2C_Bus *bus, unsigned char ADDR, unsigned char *buf, unsigned char len){
+    if(!len)
+        return 0;
+	I2C_Start(bus);
+    if(I2C_Send(bus, ADDR | 0x01)){
+        I2C_Stop(bus);
+        return 0;
+    }
+    I2C_Read_Bytes(bus, buf, len);
+	I2C_Stop(bus);
+    return 1;
+}
+
+
+/*******************************************************************************
+ * Function:        unsigned char I2C_Write_Read(const I2C_Bus *bus, unsigned char ADDR,
+ *                                               const unsigned char *wbuf, unsigned char wlen,
+ *                                               unsigned char *rbuf, unsigned char rlen)
+ * Description:     Writes wlen bytes, then reads rlen bytes, without releasing the bus
+ * Precondition:    I2C_Init called for the bus
+ * Parameters:      bus = MSSP bus handle, ADDR = 8-bit write address,
+ *                  wbuf/wlen = bytes to send (register pointer),
+ *                  rbuf/rlen = destination and byte count
+ * Return Values:   1 on success, 0 if a written byte was not acknowledged
+ * Remarks:         START, write address, wbuf, repeated START, read address,
+ *                  rbuf, STOP. With rlen = 0 it is a plain block write : the
+ *                  read address is never sent, so no read is left unclocked
+ ******************************************************************************/
+unsigned char I2C_Write_Read(const I2C_Bus *bus, unsigned char ADDR,
+                             const unsigned char *wbuf, unsigned char wlen,
+                             unsigned char *rbuf, unsigned char rlen){
+	I2C_Start(bus);
+    if(I2C_Send(bus, ADDR & 0xFE)){
+        I2C_Stop(bus);
+        return 0;
+    }
+    while(wlen--){
+        if(I2C_Send(bus, *wbuf++)){
+            I2C_Stop(bus);
+            return 0;
+        }
+    }
+    if(rlen){
+        I2C_ReStart(bus);
+        if(I2C_Send(bus, ADDR | 0x01)){
+            I2C_Stop(bus);
+            return 0;
+        }
+        I2C_Read_Bytes(bus, rbuf, rlen);
+    }
+	I2C_Stop(bus);
+    return 1;
+}
+
+
+/*******************************************************************************
+ * Function:        unsigned char I2C_Probe(const I2C_Bus *bus, unsigned char ADDR)
+ * Description:     Checks whether a device acknowledges its address
+ * Precondition:    I2C_Init called for the bus
+ * Parameters:      bus = MSSP bus handle, ADDR = 8-bit write address
+ * Return Values:   1 if the device sent ACK, 0 otherwise
+ * Remarks:         Address-only write, the device state is not changed
+ ******************************************************************************/
+unsigned char I2C_Probe(const I2C_Bus *bus, unsigned char ADDR){
+    unsigned char nack;
+
+	I2C_Start(bus);
+	nack = I2C_Send(bus, ADDR & 0xFE);
+	I2C_Stop(bus);
+    return !nack;
+}
+
+
+/*******************************************************************************
+ * Function:        unsigned char I2C_Scan(const I2C_Bus *bus,
+ *                                         unsigned char FIRST, unsigned char LAST)
+ * Description:     Probes a range of 7-bit addresses
+ * Precondition:    I2C_Init called for the bus
+ * Parameters:      bus = MSSP bus handle, FIRST/LAST = 7-bit address range
+ * Return Values:   8-bit write address of the first responder, or I2C_NO_DEVICE
+ * Remarks:         None
+ ******************************************************************************/
+unsigned char I2C_Scan(const I2C_Bus *bus, unsigned char FIRST, unsigned char LAST){
+    unsigned char addr;
+
+    for(addr = FIRST; addr <= LAST; addr++){
+        if(I2C_Probe(bus, addr << 1))
+            return addr << 1;
+    }
+    return I2C_NO_DEVICE;
+}
+
+
+#if I2C_TRACE
+/*******************************************************************************
+ * Function:        void I2C_Trace_Init(void)
+ * Description:     Starts Timer1 as the free running trace time base
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         FOSC/4 with 1:8 prescale, 0.5 us per count at 64 MHz
+ *                  (2 us at 16 MHz, 32 us at 1 MHz : pass -t to the decoder)
+ ******************************************************************************/
+void I2C_Trace_Init(void){
+    T1CON = 0b00110110;             // FOSC/4, 1:8, 16-bit read/write, off
+    TMR1 = 0;
+    T1CONbits.TMR1ON = 1;
+    i2c_trace_head = 0;
+    i2c_trace_count = 0;
+}
+
+
+/*******************************************************************************
+ * Function:        static void I2C_Trace_Put(unsigned char c)
+ * Description:     Sends one character on EUSART1
+ ******************************************************************************/
+static void I2C_Trace_Put(unsigned char c){
+    while(!PIR1bits.TX1IF);
+    TXREG1 = c;
+}
+
+static void I2C_Trace_Hex(unsigned char b){
+    const char *hex = "0123456789abcdef";
+
+    I2C_Trace_Put(hex[b >> 4]);
+    I2C_Trace_Put(hex[b & 0x0F]);
+}
+
+
+/*******************************************************************************
+ * Function:        void I2C_Trace_Dump(void)
+ * Description:     Prints the trace, oldest record first, on EUSART1
+ * Precondition:    I2C_Trace_Init called
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         One line per record : "T aa dd ff tttt" (hex)
+ ******************************************************************************/
+void I2C_Trace_Dump(void){
+    unsigned char i, idx;
+    unsigned char speed = Clock_Get();
+    I2C_Trace_Record *rec;
+
+    Clock_Set(CLOCK_64MHZ);         // SPBRG1 below is for 64 MHz
+
+    TRISCbits.TRISC6 = 0;           // TX1
+    BAUDCON1 = 0b00001000;          // BRG16
+    SPBRGH1 = 0;
+    SPBRG1 = 138;                   // 64 MHz / (4 * (138 + 1)) = 115108 baud
+    TXSTA1 = 0b00100100;            // TXEN, BRGH
+    RCSTA1 = 0b10000000;            // SPEN
+
+    idx = (i2c_trace_head - i2c_trace_count) & (I2C_TRACE_DEPTH - 1);
+    for(i = 0; i < i2c_trace_count; i++){
+        rec = &i2c_trace[idx];
+        I2C_Trace_Put('T');
+        I2C_Trace_Put(' ');
+        I2C_Trace_Hex(rec->addr);
+        I2C_Trace_Put(' ');
+        I2C_Trace_Hex(rec->data);
+        I2C_Trace_Put(' ');
+        I2C_Trace_Hex(rec->flags);
+        I2C_Trace_Put(' ');
+        I2C_Trace_Hex(rec->time >> 8);
+        I2C_Trace_Hex(rec->time & 0xFF);
+        I2C_Trace_Put('\r');
+        I2C_Trace_Put('\n');
+        idx = (idx + 1) & (I2C_TRACE_DEPTH - 1);
+    }
+    I2C_Trace_Put('E');
+    I2C_Trace_Put('\r');
+    I2C_Trace_Put('\n');
+    while(!TXSTA1bits.TRMT);        // last stop bit out before the clock moves
+
+    Clock_Set(speed);
+}
+#endif
+
+
+#if !SEGMENT_BC_PORTC
+/*******************************************************************************
+ * Function:        unsigned char I2C_Pins_Take(const I2C_Bus *bus)
+ * Description:     Lends SCL and SDA out as plain outputs between transactions
+ * Precondition:    I2C_Init
+ * Parameters:      bus = MSSP bus handle
+ * Return Values:   1 when the pins are lent out, 0 while a transaction is open
+ * Remarks:         Both lines are left high (bus idle). Change them only
+ *                  through I2C_Pins_Write. I2C_Start waits for
+ *                  I2C_Pins_Release before it takes them back.
+ ******************************************************************************/
+unsigned char I2C_Pins_Take(const I2C_Bus *bus){
+    if(*bus->open)
+        return 0;
+    *bus->lent = 1;
+    if(*bus->con1 & I2C_SSPEN){
+        *bus->con1 &= (unsigned char)~I2C_SSPEN;    // pins fall back to the pull-ups
+        *bus->lat |= bus->pin_mask;
+        *bus->tris &= (unsigned char)~bus->pin_mask;
+    }
+    return 1;
+}
+
+
+/*******************************************************************************
+ * Function:        void I2C_Pins_Write(const I2C_Bus *bus, unsigned char scl, unsigned char sda)
+ * Description:     Drives lent-out SCL and SDA pins without a start or a stop
+ * Precondition:    I2C_Pins_Take returned 1
+ * Parameters:      bus = MSSP bus handle, scl/sda = new pin levels
+ * Return Values:   None
+ * Remarks:         SDA only changes while SCL is low. Clock edges alone are
+ *                  ignored by slaves that have not seen a start.
+ ******************************************************************************/
+void I2C_Pins_Write(const I2C_Bus *bus, unsigned char scl, unsigned char sda){
+    unsigned char sda_mask = bus->pin_mask & (unsigned char)~bus->scl_mask;
+
+    *bus->lat &= (unsigned char)~bus->scl_mask;
+    if(sda)
+        *bus->lat |= sda_mask;
+    else
+        *bus->lat &= (unsigned char)~sda_mask;
+    if(scl)
+        *bus->lat |= bus->scl_mask;
+}
+
+
+/*******************************************************************************
+ * Function:        void I2C_Pins_Release(const I2C_Bus *bus)
+ * Description:     Ends a loan from I2C_Pins_Take
+ * Precondition:    None
+ * Parameters:      bus = MSSP bus handle
+ * Return Values:   None
+ * Remarks:         The pins keep their levels until I2C_Start walks them
+ *                  back to idle
+ ******************************************************************************/
+void I2C_Pins_Release(const I2C_Bus *bus){
+    *bus->lent = 0;
+}
+#endif
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   i2c.h
  * Author: Aditya Chaudhary
  *
@@ -15,30 +15,177 @@ extern "C" {
 #include <xc.h>
 #include <stdint.h>
 #include <string.h>
-#include <stdio.h>
-#include <math.h>
-    
+
 /*********** G E N E R A L   D E F I N E S ************************************/
 #define I2C_INPUT   1
 #define I2C_LOW     0
 #define I2C_HIGH    1
 #define I2C_SPEED	100         // Define i2c speed kbps
-    
+#define I2C_NO_DEVICE 0x00      // I2C_Scan result when nobody answered
+
+/*********** B U S   S E L E C T I O N ****************************************/
+/*
+ * MSSP1 shares RC3 with the relay output. Set I2C_BUS1_ENABLE to 1 only on
+ * boards where the relay has been moved to RC5 (see RELAY_LAT and
+ * RELAY_TRIS in output.h).
+ */
+#ifndef I2C_BUS1_ENABLE
+#define I2C_BUS1_ENABLE 0
+#endif
+
+/*********** T R A C E ********************************************************/
+/*
+ * I2C_TRACE=1 records every byte sent on any bus (address, data, ACK and a
+ * Timer1 time stamp) into a RAM ring buffer. I2C_Trace_Dump prints it on
+ * EUSART1 (TX1 = RC6, 115200 8N1) for tools/lcd_trace_decode.c.
+ */
+#ifndef I2C_TRACE
+#define I2C_TRACE 0
+#endif
+#ifndef I2C_TRACE_DEPTH
+#define I2C_TRACE_DEPTH 64          // records kept, power of two
+#endif
+#define I2C_TRACE_NACK  0x01        // slave did not acknowledge
+#define I2C_TRACE_ADDR  0x02        // address byte (first byte after a start)
+
 /*********** P O R T   D E F I N E S ******************************************/
 #define SDA2        RB2				// Data pin for i2c
 #define SCK2        RB1				// Clock pin for i2c
 #define SDA2_DIR    TRISBbits.RB2   // Data pin direction
-#define SCK2_DIR	TRISBbits.RB1	// Clock pin direction  
+#define SCK2_DIR	TRISBbits.RB1	// Clock pin direction
+
+#define SDA1        RC4				// Data pin for i2c bus 1
+#define SCK1        RC3				// Clock pin for i2c bus 1
+
+/*********** P I N   S H A R I N G ********************************************/
+/*
+ * On the original board segments b and c of the 7-segment display sit on
+ * RB1/RB2, the SCL2/SDA2 pins. Between transactions I2C_Pins_Take switches
+ * MSSP2 off and lends the pins out; I2C_Pins_Write then moves SDA only while
+ * SCL is low, so the LCD expander and the RTC never see a start or a stop.
+ * I2C_Start takes the pins back once the borrower has let go of them with
+ * I2C_Pins_Release (the display scan does at the end of every lit digit).
+ *
+ * Boards reworked with segment b moved to RC4 and segment c to RC5 build
+ * with SEGMENT_BC_PORTC=1 instead: MSSP2 then keeps RB1/RB2 full time and
+ * the LCD bus is never switched off. The rework uses the pins that
+ * I2C_BUS1_ENABLE gives to SDA1 and the relay, so the two exclude each other.
+ */
+#ifndef SEGMENT_BC_PORTC
+#define SEGMENT_BC_PORTC 0
+#endif
+#if SEGMENT_BC_PORTC && I2C_BUS1_ENABLE
+#error "SEGMENT_BC_PORTC needs RC4/RC5, which I2C_BUS1_ENABLE uses for SDA1 and the relay"
+#endif
+
+/*********** S S P x C O N 2   B I T S ****************************************/
+#define I2C_SEN     0x01            // Start condition enable
+#define I2C_RSEN    0x02            // Repeated start condition enable
+#define I2C_PEN     0x04            // Stop condition enable
+#define I2C_RCEN    0x08            // Receive enable
+#define I2C_ACKEN   0x10            // Acknowledge sequence enable
+#define I2C_ACKDT   0x20            // Acknowledge data bit
+#define I2C_ACKSTAT 0x40            // Acknowledge status from slave
+
+/*********** B U S   H A N D L E **********************************************/
+/*
+ * One handle per MSSP module. Every driver call takes the handle, so the
+ * two buses keep separate register sets and never wait on each other.
+ */
+typedef struct {
+    volatile unsigned char *con1;   // SSPxCON1
+    volatile unsigned char *con2;   // SSPxCON2
+    volatile unsigned char *stat;   // SSPxSTAT
+    volatile unsigned char *add;    // SSPxADD (baud rate reload)
+    volatile unsigned char *buf;    // SSPxBUF
+    volatile unsigned char *pir;    // PIRx register holding SSPxIF
+    unsigned char if_mask;          // SSPxIF bit in *pir
+    volatile unsigned char *tris;   // TRISx of the SCL/SDA pins
+    volatile unsigned char *ansel;  // ANSELx of the SCL/SDA pins
+    volatile unsigned char *lat;    // LATx of the SCL/SDA pins
+    unsigned char pin_mask;         // SCL | SDA bits in tris/ansel/lat
+    unsigned char scl_mask;         // SCL bit alone
+    volatile unsigned char *open;   // set from I2C_Start to I2C_Stop
+    volatile unsigned char *lent;   // set from I2C_Pins_Take to I2C_Pins_Release
+} I2C_Bus;
+
+extern const I2C_Bus I2C_BUS2;      // MSSP2 : SCL = RB1, SDA = RB2
+#if I2C_BUS1_ENABLE
+extern const I2C_Bus I2C_BUS1;      // MSSP1 : SCL = RC3, SDA = RC4
+#endif
 
 /*********** P R O T O T Y P E S **********************************************/
-void I2C2_Init(void);
-void I2C2_Start(void);
-void I2C2_ReStart(void);
-void I2C2_Stop(void);
-void I2C2_Send_ACK(void);
-void I2C2_Send_NACK(void);
-unsigned char I2C2_Send(unsigned char BYTE);
-unsigned char I2C2_Read(void);
+void I2C_Init(const I2C_Bus *bus);
+void I2C_Set_Speed(const I2C_Bus *bus, unsigned long FOSC);
+void I2C_Start(const I2C_Bus *bus);
+void I2C_ReStart(const I2C_Bus *bus);
+void I2C_Stop(const I2C_Bus *bus);
+void I2C_Send_ACK(const I2C_Bus *bus);
+void I2C_Send_NACK(const I2C_Bus *bus);
+unsigned char I2C_Send(const I2C_Bus *bus, unsigned char BYTE);
+unsigned char I2C_Read(const I2C_Bus *bus);
+unsigned char I2C_Read_Block(const I2C_Bus *bus, unsigned char ADDR, unsigned char *buf, unsigned char len);
+unsigned char I2C_Write_Read(const I2C_Bus *bus, unsigned char ADDR,
+                             const unsigned char *wbuf, unsigned char wlen,
+                             unsigned char *rbuf, unsigned char rlen);
+unsigned char I2C_Probe(const I2C_Bus *bus, unsigned char ADDR);
+unsigned char I2C_Scan(const I2C_Bus *bus, unsigned char FIRST, unsigned char LAST);
+#if !SEGMENT_BC_PORTC
+unsigned char I2C_Pins_Take(const I2C_Bus *bus);
+void I2C_Pins_Write(const I2C_Bus *bus, unsigned char scl, unsigned char sda);
+void I2C_Pins_Release(const I2C_Bus *bus);
+#endif
+
+#if I2C_TRACE
+typedef struct {
+    unsigned char addr;             // address of the current transaction
+    unsigned char data;             // byte put on the bus
+    unsigned char flags;            // I2C_TRACE_NACK | I2C_TRACE_ADDR
+    unsigned int time;              // TMR1, 0.5 us per count at 64 MHz
+} I2C_Trace_Record;
+
+void I2C_Trace_Init(void);
+void I2C_Trace_Dump(void);
+#endif
+
+#ifdef I2C_HOST
+/*
+ * Host builds (tools/sim) : I2C_Wait hands every bus event to the simulated
+ * MSSP first, which completes it and sets SSPxIF. I2C_Host_Idle lets time
+ * pass in the loops that wait on RAM instead of a register.
+ */
+void I2C_Host_Event(const I2C_Bus *bus);
+void I2C_Host_Idle(void);
+#endif
+
+/* MSSP2 shorthands, kept for the existing LCD code */
+#define I2C2_Init()         I2C_Init(&I2C_BUS2)
+#define I2C2_Start()        I2C_Start(&I2C_BUS2)
+#define I2C2_ReStart()      I2C_ReStart(&I2C_BUS2)
+#define I2C2_Stop()         I2C_Stop(&I2C_BUS2)
+#define I2C2_Send_ACK()     I2C_Send_ACK(&I2C_BUS2)
+#define I2C2_Send_NACK()    I2C_Send_NACK(&I2C_BUS2)
+#define I2C2_Send(BYTE)     I2C_Send(&I2C_BUS2, (BYTE))
+#define I2C2_Read()         I2C_Read(&I2C_BUS2)
+#define I2C2_Read_Block(ADDR, BUF, LEN) \
+                            I2C_Read_Block(&I2C_BUS2, (ADDR), (BUF), (LEN))
+#define I2C2_Write_Read(ADDR, WBUF, WLEN, RBUF, RLEN) \
+                            I2C_Write_Read(&I2C_BUS2, (ADDR), (WBUF), (WLEN), (RBUF), (RLEN))
+
+#if I2C_BUS1_ENABLE
+#define I2C1_Init()         I2C_Init(&I2C_BUS1)
+#define I2C1_Start()        I2C_Start(&I2C_BUS1)
+#define I2C1_ReStart()      I2C_ReStart(&I2C_BUS1)
+#define I2C1_Stop()         I2C_Stop(&I2C_BUS1)
+#define I2C1_Send_ACK()     I2C_Send_ACK(&I2C_BUS1)
+#define I2C1_Send_NACK()    I2C_Send_NACK(&I2C_BUS1)
+#define I2C1_Send(BYTE)     I2C_Send(&I2C_BUS1, (BYTE))
+#define I2C1_Read()         I2C_Read(&I2C_BUS1)
+#define I2C1_Read_Block(ADDR, BUF, LEN) \
+                            I2C_Read_Block(&I2C_BUS1, (ADDR), (BUF), (LEN))
+#define I2C1_Write_Read(ADDR, WBUF, WLEN, RBUF, RLEN) \
+                            I2C_Write_Read(&I2C_BUS1, (ADDR), (WBUF), (WLEN), (RBUF), (RLEN))
+#endif
 
 
 
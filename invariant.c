@@ -0,0 +1,58 @@
+/*
+ * File:   invariant.c
+ *
+ * Run time invariant checks for bench builds.
+ */
+
+#include <xc.h>
+#include "invariant.h"
+
+#if INVARIANT_CHECKS
+#include "buzzer.h"
+#include "lcd.h"
+
+static unsigned char invariant_first;   // first code that failed, 0 = none
+static unsigned int invariant_count;    // failures seen
+
+/*******************************************************************************
+ * Function:        void Invariant_Fail(unsigned char code)
+ * Description:     Reports a broken invariant
+ * Precondition:    Main loop context (uses the LCD bus)
+ * Parameters:      code = INV_* failure code
+ * Return Values:   None
+ * Remarks:         Only the first code is latched, every failure is counted
+ ******************************************************************************/
+void Invariant_Fail(unsigned char code){
+    if(!invariant_first)
+        invariant_first = code;
+    if(invariant_count < 0xFFFF)
+        invariant_count++;
+
+    Buzzer_Play(&BUZZER_ERROR);
+
+    LCD_Set_Cursor(2, lcd_geometry.cols - 5);
+    LCD_Write_String_ROM("INV ");
+    LCD_Write_Char('0' + code / 10);
+    LCD_Write_Char('0' + code % 10);
+
+#if I2C_TRACE
+    I2C_Trace_Dump();
+#endif
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Invariant_First(void)
+ * Description:     First failure code since reset, 0 if none
+ ******************************************************************************/
+unsigned char Invariant_First(void){
+    return invariant_first;
+}
+
+/*******************************************************************************
+ * Function:        unsigned int Invariant_Count(void)
+ * Description:     Failures since reset, saturating
+ ******************************************************************************/
+unsigned int Invariant_Count(void){
+    return invariant_count;
+}
+#endif
@@ -0,0 +1,49 @@
+/*
+ * File:   invariant.h
+ *
+ * Run time invariant checks for bench builds.
+ */
+
+#ifndef INVARIANT_H
+#define	INVARIANT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+/*
+ * INVARIANT_CHECKS=1 compiles the checks in. A failure is latched (first
+ * code and count), sounds BUZZER_ERROR and shows "INV nn" at the right of
+ * LCD row 2, and with I2C_TRACE the bus history is dumped as well. The
+ * firmware keeps running so a long soak test shows every kind of failure.
+ */
+#ifndef INVARIANT_CHECKS
+#define INVARIANT_CHECKS 0
+#endif
+
+/* Failure codes */
+#define INV_DIGITS_STORED   1           // EEPROM digits outside 0-9 / 0-5
+#define INV_DIGITS_RUNNING  2           // countdown digits outside their range
+#define INV_RELAY_EXPIRED   3           // relay still on after expiry
+#define INV_EEPROM_INIT     4           // init flag missing after initialisation
+#define INV_CHECKPOINT_LEFT 5           // resume record left after a run ended
+#define INV_EDIT_DIGITS     6           // edit buffer digit past its field limit
+
+#if INVARIANT_CHECKS
+#define INVARIANT(COND, CODE)   do { if (!(COND)) Invariant_Fail(CODE); } while (0)
+
+void Invariant_Fail(unsigned char code);
+unsigned char Invariant_First(void);
+unsigned int Invariant_Count(void);
+#else
+#define INVARIANT(COND, CODE)   ((void)0)
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* INVARIANT_H */
@@ -0,0 +1,384 @@
+/*
+ * File:   lcd.c
+ *
+ * HD44780 character LCD behind a PCF8574 I2C backpack (4-bit mode).
+ * Split out of main.c, 10-06-2023 by Aditya Chaudhary <ac3101282@gmail.com>
+ */
+
+#include <xc.h>
+#include "clock.h"
+#include "lcd.h"
+
+unsigned char RS, i2c_add, BackLight_State = LCD_BACKLIGHT;
+
+const LCD_Geometry lcd_geometry = {LCD_COLS, LCD_ROWS, LCD_ROW_OFFSETS};
+
+/* Shadow of both 40 character DDRAM lines, replayed after a resync */
+static unsigned char lcd_shadow[2][LCD_LINE_LEN];
+static unsigned char lcd_ac; // DDRAM address counter as we drove it
+
+/* Custom characters, kept so a resync can put them back */
+static const unsigned char *lcd_cgram;
+static unsigned char lcd_cgram_first, lcd_cgram_count;
+static void LCD_Write_CGRAM(void);
+
+/* Progress bar : glyph n has the n left columns lit, rows 0..6 */
+static const unsigned char lcd_bar_glyphs[5 * 8] = {
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00,
+    0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00,
+    0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00,
+    0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x00,
+    0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00,
+};
+static unsigned char lcd_bar_row;
+static unsigned char lcd_bar_level[LCD_COLS]; // fill of each cell as shown, 0..5
+
+/*
+ * @desc : advance a DDRAM address the way the controller does (I/D = 1).
+ */
+static unsigned char LCD_Next_Address(unsigned char AC)
+{
+    if (AC == LCD_LINE_LEN - 1)
+        return 0x40;
+    if (AC == 0x40 + LCD_LINE_LEN - 1)
+        return 0x00;
+    return AC + 1;
+}
+
+static void LCD_Shadow_Clear(void)
+{
+    memset(lcd_shadow, ' ', sizeof(lcd_shadow));
+    lcd_ac = 0;
+}
+
+void LCD_Init(unsigned char I2C_Add)
+{
+    i2c_add = I2C_Add;
+    LCD_Shadow_Clear();
+    IO_Expander_Write(0x00);
+    Delay_ms(30);
+    LCD_CMD(0x03);
+    Delay_ms(5);
+    LCD_CMD(0x03);
+    Delay_ms(5);
+    LCD_CMD(0x03);
+    Delay_ms(5);
+    LCD_CMD(LCD_RETURN_HOME);
+    Delay_ms(5);
+    LCD_CMD(0x20 | (LCD_TYPE << 2));
+    Delay_ms(50);
+    LCD_CMD(LCD_TURN_ON);
+    Delay_ms(50);
+    LCD_CMD(LCD_CLEAR);
+    Delay_ms(50);
+    LCD_CMD(LCD_ENTRY_MODE_SET | LCD_RETURN_HOME);
+    Delay_ms(50);
+
+    LCD_Load_CGRAM(LCD_BAR_CHAR(1), lcd_bar_glyphs, 5); // once, the glyphs stay until power off
+}
+
+void IO_Expander_Write(unsigned char Data)
+{
+    I2C_Start(LCD_BUS);
+    I2C_Send(LCD_BUS, i2c_add);
+    I2C_Send(LCD_BUS, Data | BackLight_State);
+    I2C_Stop(LCD_BUS);
+}
+
+void LCD_Write_4Bit(unsigned char Nibble)
+{
+    // Get The RS Value To LSB OF Data
+    Nibble |= RS;
+    IO_Expander_Write(Nibble | LCD_EN);
+    IO_Expander_Write(Nibble & ~LCD_EN);
+    Delay_us(50);
+}
+
+void LCD_CMD(unsigned char CMD)
+{
+    RS = 0; // Command Register Select
+    LCD_Write_4Bit(CMD & 0xF0);
+    LCD_Write_4Bit((CMD << 4) & 0xF0);
+}
+
+void LCD_Write_Char(char Data)
+{
+    lcd_shadow[lcd_ac >> 6][lcd_ac & 0x3F] = Data;
+    lcd_ac = LCD_Next_Address(lcd_ac); // address counter auto-increments
+
+    RS = 1; // Data Register Select
+    LCD_Write_4Bit(Data & 0xF0);
+    LCD_Write_4Bit((Data << 4) & 0xF0);
+}
+
+/*
+ * @desc : write a string literal or other const text at the cursor. The
+ *         pointer only ever sees program memory, so XC8 gives it the 2-byte
+ *         ROM class and the text never takes a RAM copy.
+ */
+void LCD_Write_String_ROM(const char *Str)
+{
+    while (*Str)
+        LCD_Write_Char(*Str++);
+}
+
+/*
+ * @desc : one instruction or character inside an open expander transaction.
+ *         Each byte on the bus takes 90 us at 100 kHz, longer than the 37 us
+ *         the controller needs, so no delay is added between them.
+ */
+static void LCD_Send_Byte(unsigned char Byte, unsigned char Rs)
+{
+    unsigned char high = (Byte & 0xF0) | Rs | BackLight_State;
+    unsigned char low = (Byte << 4) | Rs | BackLight_State;
+
+    I2C_Send(LCD_BUS, high | LCD_EN);
+    I2C_Send(LCD_BUS, high);
+    I2C_Send(LCD_BUS, low | LCD_EN);
+    I2C_Send(LCD_BUS, low);
+}
+
+/*
+ * @desc : write LEN characters of Text from ROW, COL in one i2c transaction :
+ *         start, address, the cursor set (left out when the address counter
+ *         is already there), every data nibble, stop. A field that already
+ *         matches the shadow is not sent at all. Text needs no terminator.
+ */
+void LCD_Write_Field(unsigned char ROW, unsigned char COL, const char *Text, unsigned char LEN)
+{
+    unsigned char AC, i;
+    unsigned char *shadow;
+
+    if (LEN == 0 || ROW < 1 || ROW > lcd_geometry.rows || COL < 1 || COL + LEN - 1 > lcd_geometry.cols)
+        return;
+
+    AC = lcd_geometry.row_offset[ROW - 1] + COL - 1;
+    shadow = &lcd_shadow[AC >> 6][AC & 0x3F];
+
+    for (i = 0; i < LEN; i++)
+        if (shadow[i] != Text[i])
+            break;
+    if (i == LEN)
+        return; // already on the screen
+
+    I2C_Start(LCD_BUS);
+    I2C_Send(LCD_BUS, i2c_add);
+    if (AC != lcd_ac)
+        LCD_Send_Byte(0x80 | AC, 0);
+    for (i = 0; i < LEN; i++)
+    {
+        shadow[i] = Text[i];
+        LCD_Send_Byte(Text[i], 1); // RS = 1, data register
+    }
+    I2C_Stop(LCD_BUS);
+
+    lcd_ac = LCD_Next_Address(AC + LEN - 1);
+}
+
+/*
+ * @desc : move the cursor, ROW 1..rows and COL 1..cols of the configured
+ *         geometry. Positions outside the display are ignored.
+ */
+void LCD_Set_Cursor(unsigned char ROW, unsigned char COL)
+{
+    if (ROW < 1 || ROW > lcd_geometry.rows || COL < 1 || COL > lcd_geometry.cols)
+        return;
+
+    lcd_ac = lcd_geometry.row_offset[ROW - 1] + COL - 1;
+    LCD_CMD(0x80 | lcd_ac);
+}
+
+void Backlight()
+{
+    BackLight_State = LCD_BACKLIGHT;
+    IO_Expander_Write(0);
+}
+
+void noBacklight()
+{
+    BackLight_State = LCD_NOBACKLIGHT;
+    IO_Expander_Write(0);
+}
+
+void LCD_SL()
+{
+    LCD_CMD(LCD_SHIFT_LEFT);
+    Delay_us(40);
+}
+
+void LCD_SR()
+{
+    LCD_CMD(LCD_SHIFT_RIGHT);
+    Delay_us(40);
+}
+
+void LCD_CLR()
+{
+    LCD_CMD(0x01);
+    Delay_ms(2); // clear display takes 1.52 ms on the HD44780
+    LCD_Shadow_Clear();
+}
+
+unsigned char LCD_Read_4Bit(void)
+{
+    // D7..D4 high so the PCF8574 quasi-bidirectional pins can be read back
+    unsigned char Out = 0xF0 | LCD_RW | RS | LCD_EN | BackLight_State;
+    unsigned char Nibble = 0xFF;
+
+    // raise E and sample the pins in one transaction (repeated START between)
+    I2C_Write_Read(LCD_BUS, i2c_add, &Out, 1, &Nibble, 1);
+    IO_Expander_Write(0xF0 | LCD_RW | RS);
+    return Nibble & 0xF0;
+}
+
+/*
+ * @desc : read busy flag and address counter (RS = 0, R/W = 1).
+ * @return : address counter, bit 7 holds the busy flag.
+ */
+unsigned char LCD_Read_Address(void)
+{
+    unsigned char AC;
+
+    RS = 0;
+    AC = LCD_Read_4Bit();
+    AC |= LCD_Read_4Bit() >> 4;
+    IO_Expander_Write(0x00); // R/W back to write
+    return AC;
+}
+
+/*
+ * @desc : bring the 4-bit interface back in step without LCD_Init.
+ *         Three 0x3 nibbles force 8-bit mode whatever nibble phase the
+ *         controller was in, 0x2 returns to 4-bit mode, and the shadow is
+ *         replayed, one i2c transaction per line, so the screen content and
+ *         cursor are restored.
+ */
+void LCD_Resync(void)
+{
+    unsigned char line, col, ac = lcd_ac;
+
+    RS = 0;
+    LCD_Write_4Bit(0x30);
+    Delay_ms(5); // the first 0x3 needs 4.1 ms, the next ones far less than a write
+    LCD_Write_4Bit(0x30);
+    LCD_Write_4Bit(0x30);
+    LCD_Write_4Bit(0x20);
+    LCD_CMD(0x20 | (LCD_TYPE << 2));
+    LCD_CMD(LCD_TURN_ON);
+    LCD_CMD(LCD_ENTRY_MODE_SET | LCD_RETURN_HOME);
+
+    for (line = 0; line < 2; line++)
+    {
+        I2C_Start(LCD_BUS); // cursor set and the whole line in one transaction
+        I2C_Send(LCD_BUS, i2c_add);
+        LCD_Send_Byte(0x80 | (line << 6), 0);
+        for (col = 0; col < LCD_LINE_LEN; col++)
+            LCD_Send_Byte(lcd_shadow[line][col], 1);
+        I2C_Stop(LCD_BUS);
+    }
+
+    lcd_ac = ac;
+    LCD_Write_CGRAM(); // CGRAM is lost too when the module browned out; ends with the cursor restored
+}
+
+/*
+ * @desc : send the registered custom characters and put the cursor back,
+ *         in one i2c transaction. Data goes straight to the controller, the
+ *         DDRAM shadow is not touched.
+ */
+static void LCD_Write_CGRAM(void)
+{
+    unsigned char i;
+
+    I2C_Start(LCD_BUS);
+    I2C_Send(LCD_BUS, i2c_add);
+    if (lcd_cgram_count)
+    {
+        LCD_Send_Byte(0x40 | (lcd_cgram_first << 3), 0);
+        for (i = 0; i < lcd_cgram_count * 8; i++)
+            LCD_Send_Byte(lcd_cgram[i], 1);
+    }
+    LCD_Send_Byte(0x80 | lcd_ac, 0); // back to DDRAM
+    I2C_Stop(LCD_BUS);
+}
+
+/*
+ * @desc : define COUNT custom characters from code FIRST (0..7) on.
+ *         Rows holds 8 bytes per character, top row first, 5 low bits used.
+ *         The table must stay valid, LCD_Resync loads it again.
+ */
+void LCD_Load_CGRAM(unsigned char FIRST, const unsigned char *Rows, unsigned char COUNT)
+{
+    lcd_cgram = Rows;
+    lcd_cgram_first = FIRST;
+    lcd_cgram_count = COUNT;
+    LCD_Write_CGRAM();
+}
+
+/*
+ * @desc : start an empty progress bar across ROW.
+ */
+void LCD_Bar_Init(unsigned char ROW)
+{
+    unsigned char i;
+
+    lcd_bar_row = ROW;
+    LCD_Set_Cursor(ROW, 1);
+    for (i = 0; i < lcd_geometry.cols; i++)
+    {
+        lcd_bar_level[i] = 0;
+        LCD_Write_Char(' ');
+    }
+}
+
+/*
+ * @desc : show STEPS of LCD_BAR_STEPS filled. Only cells whose fill changed
+ *         are written, one cursor set and one character each, so a bar that
+ *         moves one step costs a single cell.
+ */
+void LCD_Bar_Set(unsigned char STEPS)
+{
+    unsigned char i, level;
+
+    for (i = 0; i < lcd_geometry.cols; i++)
+    {
+        if (STEPS >= 5)
+        {
+            level = 5;
+            STEPS -= 5;
+        }
+        else
+        {
+            level = STEPS;
+            STEPS = 0;
+        }
+
+        if (level != lcd_bar_level[i])
+        {
+            lcd_bar_level[i] = level;
+            LCD_Set_Cursor(lcd_bar_row, i + 1);
+            LCD_Write_Char(level ? LCD_BAR_CHAR(level) : ' ');
+        }
+    }
+}
+
+/*
+ * @desc : cheap health check : compare the address counter with the cursor
+ *         we believe is set. A loose backpack, ESD hit or nibble slip shows
+ *         up as a mismatch, which is repaired with LCD_Resync.
+ */
+void LCD_Check(void)
+{
+    unsigned char AC = LCD_Read_Address();
+
+    if (AC & 0x80)
+        return; // busy, try again on the next check
+
+    if (AC != lcd_ac)
+    {
+#if I2C_TRACE
+        I2C_Trace_Dump(); // bus history that led to the mismatch
+#endif
+        LCD_Resync();
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * File:   lcd.h
+ *
+ * HD44780 character LCD behind a PCF8574 I2C backpack (4-bit mode).
+ */
+
+#ifndef LCD_H
+#define	LCD_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+#include "i2c.h"
+
+/*LCD Function Declarations*/
+#define LCD_BACKLIGHT 0x08
+#define LCD_NOBACKLIGHT 0x00
+#define LCD_FIRST_ROW 0x80
+#define LCD_SECOND_ROW 0xC0
+#define LCD_THIRD_ROW 0x94
+#define LCD_FOURTH_ROW 0xD4
+#define LCD_CLEAR 0x01
+#define LCD_RETURN_HOME 0x02
+#define LCD_ENTRY_MODE_SET 0x04
+#define LCD_CURSOR_OFF 0x0C
+#define LCD_UNDERLINE_ON 0x0E
+#define LCD_BLINK_CURSOR_ON 0x0F
+#define LCD_MOVE_CURSOR_LEFT 0x10
+#define LCD_MOVE_CURSOR_RIGHT 0x14
+#define LCD_TURN_ON 0x0C
+#define LCD_TURN_OFF 0x08
+#define LCD_SHIFT_LEFT 0x18
+#define LCD_SHIFT_RIGHT 0x1C
+#define LCD_TYPE 2 // 0 -> 5x7 | 1 -> 5x10 | 2 -> 2 lines
+#define LCD_RW 0x02 // PCF8574 P1 -> R/W
+#define LCD_EN 0x04 // PCF8574 P2 -> E
+#define LCD_BUS (&I2C_BUS2) // i2c bus the LCD backpack sits on
+#define LCD_DEFAULT_ADDR (0x38 << 1) // PCF8574A with A2..A0 low, used when the scan finds nothing
+
+/* Geometry : pick the module at build time with LCD_MODEL (1602, 1604, 2004) */
+#ifndef LCD_MODEL
+#define LCD_MODEL 1602
+#endif
+
+#if LCD_MODEL == 2004
+#define LCD_COLS 20
+#define LCD_ROWS 4
+#define LCD_ROW_OFFSETS {0x00, 0x40, 0x14, 0x54}
+#elif LCD_MODEL == 1604
+#define LCD_COLS 16
+#define LCD_ROWS 4
+#define LCD_ROW_OFFSETS {0x00, 0x40, 0x10, 0x50}
+#else
+#define LCD_COLS 16
+#define LCD_ROWS 2
+#define LCD_ROW_OFFSETS {0x00, 0x40, 0x10, 0x50}
+#endif
+
+#define LCD_LINE_LEN 40 // DDRAM characters per controller line
+
+/* Progress bar : five CGRAM glyphs, codes 1..5, for 1..5 lit columns */
+#define LCD_BAR_CHAR(n) (n)
+#define LCD_BAR_STEPS (LCD_COLS * 5) // 80 on a 16 column module
+
+typedef struct {
+    unsigned char cols;
+    unsigned char rows;
+    unsigned char row_offset[4]; // DDRAM address of column 1 of each row
+} LCD_Geometry;
+
+extern const LCD_Geometry lcd_geometry;
+
+/* LCD Function Declaration */
+void LCD_Init(unsigned char I2C_Add);
+void IO_Expander_Write(unsigned char Data);
+void LCD_Write_4Bit(unsigned char Nibble);
+void LCD_CMD(unsigned char CMD);
+void LCD_Set_Cursor(unsigned char ROW, unsigned char COL);
+void LCD_Write_Char(char);
+void LCD_Write_String_ROM(const char *);
+void LCD_Write_Field(unsigned char ROW, unsigned char COL, const char *Text, unsigned char LEN);
+void Backlight();
+void noBacklight();
+void LCD_SR();
+void LCD_SL();
+void LCD_CLR();
+unsigned char LCD_Read_4Bit(void);
+unsigned char LCD_Read_Address(void);
+void LCD_Resync(void);
+void LCD_Check(void);
+void LCD_Load_CGRAM(unsigned char FIRST, const unsigned char *Rows, unsigned char COUNT);
+void LCD_Bar_Init(unsigned char ROW);
+void LCD_Bar_Set(unsigned char STEPS);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LCD_H */
@@ -5,53 +5,48 @@
 
 #include "config.h"
 #include <xc.h>
-#include <math.h>
+#include "clock.h"
 #include "i2c.h"
+#include "lcd.h"
+#include "tick.h"
+#include "buzzer.h"
+#include "output.h"
+#include "rtc.h"
+#include "eeprom.h"
+#include "stopwatch.h"
+#include "checkpoint.h"
+#include "runlog.h"
+#include "invariant.h"
+#include "render.h"
+#include "segmux.h"
 
 #define PORT 1
 
-/*LCD Function Declarations*/
-#define LCD_BACKLIGHT 0x08
-#define LCD_NOBACKLIGHT 0x00
-#define LCD_FIRST_ROW 0x80
-#define LCD_SECOND_ROW 0xC0
-#define LCD_THIRD_ROW 0x94
-#define LCD_FOURTH_ROW 0xD4
-#define LCD_CLEAR 0x01
-#define LCD_RETURN_HOME 0x02
-#define LCD_ENTRY_MODE_SET 0x04
-#define LCD_CURSOR_OFF 0x0C
-#define LCD_UNDERLINE_ON 0x0E
-#define LCD_BLINK_CURSOR_ON 0x0F
-#define LCD_MOVE_CURSOR_LEFT 0x10
-#define LCD_MOVE_CURSOR_RIGHT 0x14
-#define LCD_TURN_ON 0x0C
-#define LCD_TURN_OFF 0x08
-#define LCD_SHIFT_LEFT 0x18
-#define LCD_SHIFT_RIGHT 0x1E
-#define LCD_TYPE 2 // 0 -> 5x7 | 1 -> 5x10 | 2 -> 2 lines
+#define LCD_CHECK_PERIOD 50 // idle refreshes between two LCD health checks
+#define IDLE_REFRESH_MS 100 // idle LCD refresh period, the CPU sits at CLOCK_IDLE in between
+#define OVER_MESSAGE_MS 2000 // how long OVER stays on the LCD after a countdown
+#define STOP_DISPLAY_MS 5000 // how long the stopped 0000 is scanned before the digits go dark
+
+/* Buttons : RC0..RC2, active low, read as bits of buttons_read() */
+#define BUTTON_1 0x01
+#define BUTTON_2 0x02
+#define BUTTON_3 0x04
+#define BUTTON_DEBOUNCE_MS 20 // pins are sampled at most this often
+
+/* Edit mode : holding button 3 repeats, faster the longer it is held */
+#define EDIT_REPEAT_DELAY_MS 500 // hold before the first repeat
+#define EDIT_REPEAT_SLOW_MS 250  // first repeat interval
+#define EDIT_REPEAT_FAST_MS 50   // the interval shrinks by a quarter per repeat down to this
+#define EDIT_LIT_MS 600          // the edited digit stops blinking this long after a change
+#define EDIT_BLINK_MASK 0x0100   // tick bit blinking the edited digit, 256 ms phases
 
 /* LCD Function Declaration */
-void LCD_Init(unsigned char I2C_Add);
-void IO_Expander_Write(unsigned char Data);
-void LCD_Write_4Bit(unsigned char Nibble);
-void LCD_CMD(unsigned char CMD);
-void LCD_Set_Cursor(unsigned char ROW, unsigned char COL);
-void LCD_Write_Char(char);
-void LCD_Write_String(char *);
-void Backlight();
-void noBacklight();
-void LCD_SR();
-void LCD_SL();
-void LCD_CLR();
-
-unsigned char RS, i2c_add, BackLight_State = LCD_BACKLIGHT;
+unsigned char LCD_Find_Address();
 
 /*Function Declarations*/
 void startUpcounter();                                         /* starts the counter from 0.0.0.0 to 9.9.9.9 and ends with OVEr */
-void display(unsigned int buttonCounter, unsigned int update); /* display the stored EEPROM values. */
-void seven_segment_config();                                   /* turn on all the displays. */
-void seven_segment_off_config();                               /* turn off all the displays. */
+void display();                                                /* display the stored EEPROM values. */
+unsigned char buttons_read();                                  /* debounced BUTTON_x bits. */
 
 /*LED Function Declarations*/
 void red_led();   // turns red led on.
@@ -61,223 +56,194 @@ void blue_led();  // turns blue led on.
 /*Timer Function Declarations*/
 void stopTimer();   // stops timer with 00.00 on display.
 void startTimer();  // starts timer
+void resumeTimer(unsigned long remaining, unsigned long total); // continue a countdown saved at power fail
+void countdown(int8_t h1, int8_t h2, int8_t m1, int8_t m2, unsigned char first_minute, unsigned long total);
 void stopMessage(); // display 0VEr on display.
+void startStopwatch(); // count up with laps on button 3.
+void stopwatch_frame(unsigned long ms);                  /* publish MM.SS to both displays. */
+void lcd_show_lap(unsigned int number, unsigned long ms); /* lap on the second LCD row. */
+void lcd_show_log(unsigned char n);                      /* run log entry on the second LCD row. */
+
+/*Edit Mode Function Declarations*/
+void edit_begin();              /* load the stored time into the edit buffer. */
+void edit_end();                /* write the edit buffer back to EEPROM, once. */
+void edit_step(uint8_t field);  /* increment one digit of the buffer within its limit. */
+void edit_show(uint8_t field);  /* publish the buffer, the edited digit blinking. */
 
 /*EEPROM Function Declarations*/
-void EEPROM_Write(unsigned char, unsigned char); /* Write byte to EEPROM */
-char EEPROM_Read(unsigned char);                 /* Read byte From EEPROM */
 void EEPROM_Mem_Initialise();
 
 /* Utility Function Declaration */
-unsigned char inttochar(unsigned int digit); /* converts int type to char type */
-void lcd_print(unsigned char row, unsigned char col, char Data);
-
-/*7 Segment Data array*/
-unsigned char segment[11] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F}, segmentCounter;
-unsigned char segment_with_dot[11] = {0xBF, 0x86, 0xDB, 0xCF, 0xE6, 0xED, 0xFD, 0x87, 0xFF, 0xEF};
-int hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit, DEL;
-static unsigned int display_function_count = 0; // counts the number of times display function is called.
-
-/*LCD Function Declarations*/
-
-void LCD_Init(unsigned char I2C_Add)
-{
-    i2c_add = I2C_Add;
-    IO_Expander_Write(0x00);
-    __delay_ms(30);
-    LCD_CMD(0x03);
-    __delay_ms(5);
-    LCD_CMD(0x03);
-    __delay_ms(5);
-    LCD_CMD(0x03);
-    __delay_ms(5);
-    LCD_CMD(LCD_RETURN_HOME);
-    __delay_ms(5);
-    LCD_CMD(0x20 | (LCD_TYPE << 2));
-    __delay_ms(50);
-    LCD_CMD(LCD_TURN_ON);
-    __delay_ms(50);
-    LCD_CMD(LCD_CLEAR);
-    __delay_ms(50);
-    LCD_CMD(LCD_ENTRY_MODE_SET | LCD_RETURN_HOME);
-    __delay_ms(50);
-}
+unsigned char digits_valid(int8_t h1, int8_t h2, int8_t m1, int8_t m2); /* HH:MM digits in range */
+
+unsigned char segmentCounter;
+int8_t hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit; // count down to -1
+static unsigned char over_message_shown = 0;    // OVER is on the LCD until over_message_deadline.
+static unsigned int over_message_deadline;
+static unsigned char stop_display_shown = 0;    // 0000 is scanned until stop_display_deadline.
+static unsigned int stop_display_deadline;
+static unsigned char log_view = 0;              // run log entry shown next, 0 = newest
+
+/* Edit buffer : HHMM as one BCD digit per nibble, written back on leaving edit mode */
+typedef struct {
+    unsigned char shift; // nibble position in edit_time
+    unsigned char max;   // largest value of the digit
+} Edit_Field;
+
+static const Edit_Field edit_fields[4] = {{12, 9}, {8, 9}, {4, 5}, {0, 9}}; // H H : M M
+static unsigned int edit_time;
+static unsigned int edit_changed_at;   // tick of the last change, the digit stays lit EDIT_LIT_MS
 
-void IO_Expander_Write(unsigned char Data)
-{
-    I2C2_Start();
-    I2C2_Send(i2c_add);
-    I2C2_Send(Data | BackLight_State);
-    I2C2_Stop();
-}
-
-void LCD_Write_4Bit(unsigned char Nibble)
-{
-    // Get The RS Value To LSB OF Data
-    Nibble |= RS;
-    IO_Expander_Write(Nibble | 0x04);
-    IO_Expander_Write(Nibble & 0xFB);
-    __delay_us(50);
-}
-
-void LCD_CMD(unsigned char CMD)
-{
-    RS = 0; // Command Register Select
-    LCD_Write_4Bit(CMD & 0xF0);
-    LCD_Write_4Bit((CMD << 4) & 0xF0);
-}
-
-void LCD_Write_Char(char Data)
-{
-    RS = 1; // Data Register Select
-    LCD_Write_4Bit(Data & 0xF0);
-    LCD_Write_4Bit((Data << 4) & 0xF0);
-}
-
-void LCD_Write_String(char *Str)
+/*
+ * @desc : interrupt service routine, dispatches to the background drivers.
+ */
+void __interrupt() isr(void)
 {
-    for (int i = 0; Str[i] != '\0'; i++)
-        LCD_Write_Char(Str[i]);
-}
+    unsigned char ms;
 
-void LCD_Set_Cursor(unsigned char ROW, unsigned char COL)
-{
-    switch (ROW)
+    if (PIE1bits.TMR2IE && SEGMUX_FLAG)
     {
-    case 2:
-        LCD_CMD(0xC0 + COL - 1);
-        break;
-    case 3:
-        LCD_CMD(0x94 + COL - 1);
-        break;
-    case 4:
-        LCD_CMD(0xD4 + COL - 1);
-        break;
-    // Case 1
-    default:
-        LCD_CMD(0x80 + COL - 1);
+        SegMux_ISR(); // first, the digit timing is the most sensitive to latency
+    }
+    if (TICK_IE && TICK_FLAG)
+    {
+        ms = Tick_ISR();
+        if (ms) // not every Timer4 period at 64 MHz
+        {
+            Buzzer_Tick(ms);
+            Output_Tick(ms);
+            RTC_Tick(ms);
+            Stopwatch_Tick(ms);
+        }
+    }
+    if (PIE2bits.HLVDIE && PIR2bits.HLVDIF)
+    {
+        Checkpoint_ISR(); // supply dropping, save the countdown
     }
 }
 
-void Backlight()
-{
-    BackLight_State = LCD_BACKLIGHT;
-    IO_Expander_Write(0);
-}
-
-void noBacklight()
+/*
+ * @desc : find the LCD backpack address.
+ *         The cached address is confirmed with a single probe; only when it
+ *         does not answer are the PCF8574A (0x38-0x3F) and PCF8574 (0x20-0x27)
+ *         ranges scanned, and a new result is written back to EEPROM.
+ * @return : 8-bit write address of the LCD.
+ */
+unsigned char LCD_Find_Address()
 {
-    BackLight_State = LCD_NOBACKLIGHT;
-    IO_Expander_Write(0);
-}
+    unsigned char cached = EEPROM_Read(EE_LCD_ADDR);
+    unsigned char addr;
 
-void LCD_SL()
-{
-    LCD_CMD(0x18);
-    __delay_us(40);
-}
+    if ((cached & 0x01) == 0 && // a write address, bit 0 is the read flag
+        (((cached >> 1) >= 0x20 && (cached >> 1) <= 0x27) || ((cached >> 1) >= 0x38 && (cached >> 1) <= 0x3F)))
+    {
+        if (I2C_Probe(LCD_BUS, cached))
+            return cached;
+    }
 
-void LCD_SR()
-{
-    LCD_CMD(0x1C);
-    __delay_us(40);
-}
+    addr = I2C_Scan(LCD_BUS, 0x38, 0x3F);
+    if (addr == I2C_NO_DEVICE)
+        addr = I2C_Scan(LCD_BUS, 0x20, 0x27);
+    if (addr == I2C_NO_DEVICE)
+        return LCD_DEFAULT_ADDR; // nothing answered, keep the cache for the next boot
 
-void LCD_CLR()
-{
-    LCD_CMD(0x01);
-    __delay_us(40);
+    EEPROM_Write(EE_LCD_ADDR, addr);
+    return addr;
 }
 
 /*
  * led function definitions
- * @configuration : common anode configuration
+ * @configuration : common anode configuration, driven by the output manager.
+ *                  Calling these on every loop pass costs no port write.
  */
 void red_led()
 {
-    LATAbits.LATA5 = 0; // red led
-
-    LATAbits.LATA4 = 1;
-    LATAbits.LATA6 = 1;
+    Output_RGB(OUT_RED);
 }
 
 void green_led()
 {
-
-    LATAbits.LATA4 = 0; // green led
-
-    LATAbits.LATA5 = 1;
-    LATAbits.LATA6 = 1;
+    Output_RGB(OUT_GREEN);
 }
 
 void blue_led()
 {
-    LATAbits.LATA6 = 0; // blue led
-
-    LATAbits.LATA5 = 1;
-    LATAbits.LATA4 = 1;
+    Output_RGB(OUT_BLUE);
 }
 
 /*
- * 7 segment display function definitions
- */
-
-/*
- * @desc : turn on all displays
- * @params : none.
+ * @desc : read data from eeprom and start the timer as usual.
+ * @param : none.
  */
-void seven_segment_config()
+void startTimer()
 {
-    /*
-    LATAbits.LATA0 = 1;
-    LATAbits.LATA1 = 1;
-    LATAbits.LATA2 = 1;
-    LATAbits.LATA3 = 1;
-     */
+    countdown(EEPROM_Read(EE_HOUR_FIRST), EEPROM_Read(EE_HOUR_SECOND),
+              EEPROM_Read(EE_MINUTE_FIRST), EEPROM_Read(EE_MINUTE_SECOND), 60, 0);
 }
 
 /*
- * @desc : turn off all the displays.
- * @params : none.
+ * @desc : continue a countdown from a power fail checkpoint.
+ *         The display shows whole minutes, so the running minute is cut
+ *         short to the seconds that were left of it.
+ * @param : remaining - seconds left when the power went.
+ *          total - length of the whole run, for the progress bar and the log.
  */
-void seven_segment_off_config()
+void resumeTimer(unsigned long remaining, unsigned long total)
 {
-    /*
-    LATAbits.LATA0 = 0;
-    LATAbits.LATA1 = 0;
-    LATAbits.LATA2 = 0;
-    LATAbits.LATA3 = 0;
-    */
+    unsigned int minutes = (unsigned int)((remaining + 59) / 60);
+    unsigned int hours = minutes / 60;
+
+    minutes %= 60;
+    countdown(hours / 10, hours % 10, minutes / 10, minutes % 10,
+              (unsigned char)(remaining - ((remaining + 59) / 60 - 1) * 60), total);
 }
 
 /*
- * @desc : read data from eeprom and start the timer as usual.
- * @param : none.
+ * @desc : count down from h1 h2 : m1 m2.
+ * @param : h1, h2, m1, m2 - start time digits.
+ *          first_minute - length of the first minute in seconds (60 unless resuming).
+ *          total - length of the whole run when resuming, 0 for a new run.
  */
-void startTimer()
+void countdown(int8_t h1, int8_t h2, int8_t m1, int8_t m2, unsigned char first_minute, unsigned long total)
 {
 
-    int RESET = 0;  // variable which will help to break loop, when button 3 is pressed (represents stop timer).
-    int timeUp = 0; // help to break loop, also show stop message.
-    int hour_first_flag = 0;
-    int minute_first_flag = 0;  // variable which will reset minute digits to 59.
-    int minute_second_flag = 0; // variable which will reset minute digits to 59.
+    uint8_t RESET = 0;  // variable which will help to break loop, when button 3 is pressed (represents stop timer).
+    uint8_t timeUp = 0; // help to break loop, also show stop message.
+    uint8_t hour_first_flag = 0;
+    uint8_t minute_first_flag = 0;  // variable which will reset minute digits to 59.
+    uint8_t minute_second_flag = 0; // variable which will reset minute digits to 59.
+    unsigned int minute_end;    // RTC second at which the current minute ends.
+    unsigned int second_shown;  // last RTC second the dot was flashed for.
+    unsigned char minute_len = first_minute;
+    unsigned int minutes = (h1 * 10 + h2) * 60 + m1 * 10 + m2; // minutes set, for the run log
+    unsigned long run_seconds = minutes ? (unsigned long)(minutes - 1) * 60 + first_minute : 0;
+    unsigned int bar_second;    // RTC second the progress bar was last updated for.
+
+    if (total > run_seconds) // resumed : bar and log cover the run from its start
+    {
+        run_seconds = total;
+        minutes = (unsigned int)((total + 59) / 60);
+    }
+    Checkpoint_Total(run_seconds);
+
+    Render_Invalidate(&render_lcd); // force the first LCD update
+    Render_Set(RENDER_CLOCK, h1, h2, m1, m2, 0, 0);
+    Render_Poll(&render_segment); // the scan must not start on the last frame (OVEr)
+    LCD_Bar_Init(2);         // elapsed / total on the second row
+    bar_second = RTC_Seconds();
+
+    Output_Relay(1); // LED panel on while counting
 
-    /* reset all displays */
-    LATAbits.LATA0 = 0;
-    LATAbits.LATA1 = 0;
-    LATAbits.LATA2 = 0;
-    LATAbits.LATA3 = 0;
+    SegMux_Wake();
+    SegMux_Enable(1); // digits are scanned from Timer2
 
-    /* read data from eeprom */
-    hour_first_digit = EEPROM_Read(0x0A);  // reads data from address location 0x0A
-    hour_second_digit = EEPROM_Read(0x0B); // reads data from address location 0x0B
+    hour_first_digit = h1;
+    hour_second_digit = h2;
 
     for (hour_first_digit = hour_first_digit; hour_first_digit > -1; hour_first_digit--) // hour first digit
     {
-        seven_segment_config(); // turn on all displays
-
-        hour_first_flag = hour_first_flag + 1;
+        if (hour_first_flag < 2) // saturate, only "> 1" matters and it stays 8-bit
+            hour_first_flag++;
 
         if (hour_first_flag > 1)
             hour_second_digit = 9;
@@ -285,9 +251,8 @@ void startTimer()
         for (hour_second_digit = hour_second_digit; hour_second_digit > -1; hour_second_digit--) // hour second digit
         {
 
-            minute_first_flag = minute_first_flag + 1; // For the first time it will be 0 + 1 = 1, but if it is > 1 that means timer should start from 59
-
-            seven_segment_config(); // turn on all displays
+            if (minute_first_flag < 2)
+                minute_first_flag++; // For the first time it will be 0 + 1 = 1, but if it is > 1 that means timer should start from 59
 
             if (minute_first_flag > 1) // this means minute timer should start from 59
             {
@@ -295,13 +260,14 @@ void startTimer()
             }
             else // Original value passed
             {
-                minute_first_digit = EEPROM_Read(0x0C);
-                minute_second_digit = EEPROM_Read(0x0D);
+                minute_first_digit = m1;
+                minute_second_digit = m2;
             }
 
             for (minute_first_digit = minute_first_digit; minute_first_digit > -1; minute_first_digit--) // minute first digit
             {
-                minute_second_flag = minute_second_flag + 1;
+                if (minute_second_flag < 2)
+                    minute_second_flag++;
 
                 if (minute_second_flag > 1)
                     minute_second_digit = 9;
@@ -317,47 +283,43 @@ void startTimer()
                         break;
                     }
 
-                    for (DEL = 4990; DEL > 0; DEL--) // To create approximate 60 second delay, we need to pass 4975, as we are running with 64MHz.
-                    {
-
-                        green_led();        // turn green led on
-                        LATCbits.LATC3 = 1; // Turn LED panel off (relay off)
+                    // status led : dim green while running, amber in the last minute
+                    if ((hour_first_digit == 0) && (hour_second_digit == 0) && (minute_first_digit == 0) && (minute_second_digit == 1))
+                        Output_RGB(OUT_AMBER);
+                    else
+                        Output_RGB(OUT_DIM_GREEN);
 
-                        //  DISPLAY-1 :
-                        LATAbits.LATA0 = 1;                // TURN ON DISPLAY-1
-                        PORTB = segment[hour_first_digit]; // Find Code and send it to the PORT
-                        __delay_ms(3);                     // DELAY for turning on the display
-                        LATAbits.LATA0 = 0;                // TURN OFF DISPLAY-1
+                    // one minute of RTC seconds, the multiplex loop speed no longer sets the time
+                    second_shown = RTC_Seconds();
+                    minute_end = second_shown + minute_len;
+                    minute_len = 60;
 
-                        // DISPLAY-2 :
+                    INVARIANT(digits_valid(hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit), INV_DIGITS_RUNNING);
 
-                        LATAbits.LATA1 = 1;                 // TURN ON DISPLAY-2
-                        PORTB = segment[hour_second_digit]; // Find Code and send it to the PORT
-                        __delay_ms(3);                      // DELAY for turning on the display
-                        LATAbits.LATA1 = 0;                 // TURN OFF DISPLAY-2
+                    Checkpoint_Running((hour_first_digit * 10 + hour_second_digit) * 60 + minute_first_digit * 10 + minute_second_digit, minute_end);
 
-                        // MINUTE DISPLAY
-                        //  DISPLAY-3 :
-                        LATAbits.LATA2 = 1;                  // TURN ON DISPLAY-3
-                        PORTB = segment[minute_first_digit]; // Find Code and send it to the PORT
-                        __delay_ms(3);                       // DELAY for turning on the display
-                        LATAbits.LATA2 = 0;                  // TURN OFF DISPLAY-3
+                    Render_Set(RENDER_CLOCK, hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit, 0, 0);
+                    Render_Poll(&render_segment); // the scan picks up the new codes
 
-                        // DISPLAY-4 :
-                        LATAbits.LATA3 = 1;                   // TURN ON DISPLAY-4
-                        PORTB = segment[minute_second_digit]; // Find Code and send it to the PORT
-                        __delay_ms(3);                        // DELAY for turning on the display
-                        LATAbits.LATA3 = 0;                   // TURN OFF DISPLAY-4
+                    while ((int)(minute_end - RTC_Seconds()) > 0)
+                    {
+                        if (RTC_Seconds() != second_shown) // dot on display 2 blinks with the seconds
+                        {
+                            second_shown = RTC_Seconds();
+                            Render_Set(RENDER_CLOCK, hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit,
+                                       (second_shown & 1) ? 0x02 : 0, 0);
+                            Render_Poll(&render_segment);
+                            SegMux_Wake(); // a running countdown is not idle
+                        }
 
-                        LATAbits.LATA7 = 0; // buzzer - off
+                        Render_Poll(&render_lcd); // LCD follows the countdown
 
-                        if (DEL % 79 == 0) // Display dot pointer at regular intervals
+                        if (second_shown != bar_second) // progress bar : at most one cell per step
                         {
-                            LATAbits.LATA1 = 1; // TURN ON DISPLAY-2
-                            PORTB = 0x80;       // Find Code and send it to the PORT
-                            __delay_ms(3);      // DELAY for turning on the display
-                            LATAbits.LATA1 = 0; // TURN OFF DISPLAY-2
+                            bar_second = second_shown;
+                            LCD_Bar_Set((unsigned char)((run_seconds - Checkpoint_Remaining()) * LCD_BAR_STEPS / run_seconds));
                         }
+                        Checkpoint_Service(); // the scan runs from Timer2, an EEPROM write does not stall it
 
                         // Check state of stop_timer button
                         if (PORTCbits.RC2 == 0)
@@ -365,7 +327,7 @@ void startTimer()
                             RESET = 1; // Set the reset flag.
                             break;
                         }
-                    } // end delay loop
+                    } // end minute loop
 
                     if (RESET || timeUp)
                         break;
@@ -383,16 +345,27 @@ void startTimer()
         } // end hour second digit loop
     }     // end hour first digit loop
 
-    LATAbits.LATA7 = 1; // turn buzzer on
+    // queued in RAM, written from the idle loop
+    Log_Append(RESET ? LOG_ABORTED : LOG_EXPIRED, minutes,
+               run_seconds - (RESET ? Checkpoint_Remaining() : 0));
+    log_view = 0;
+
+    Checkpoint_Clear(); // nothing to resume any more
+    INVARIANT(Checkpoint_Load(0, 0) == 0, INV_CHECKPOINT_LEFT);
 
     if (RESET)
     {                // stop timer button pressed
+        LCD_Bar_Init(2); // blank the bar, OVER clears the screen on expiry
+        Buzzer_Play(&BUZZER_ABORT);
+        stop_display_shown = 0; // show 0000 again
         stopTimer(); // call stoptimer function irrespective of timer status.
     }
     else
     {
-        LATCbits.LATC3 = 0; // Turn LED panel off (relay off)
+        Output_Relay(0); // Turn LED panel off (relay off)
+        Buzzer_Play(&BUZZER_EXPIRED);
         stopMessage();      // display OVEr message and back to normal state.
+        INVARIANT(!Output_Relay_State(), INV_RELAY_EXPIRED);
     }
 
 } // End start timer function
@@ -406,38 +379,40 @@ void stopTimer()
 
     red_led(); // red led to indicate stop timer.
 
-    LATCbits.LATC3 = 0; // Turn LED panel off (relay off)
-
-    /*Display 00.00*/
-    seven_segment_config(); // turn on all displays.
+    Output_Relay(0); // Turn LED panel off (relay off)
 
-    segmentCounter = 0;
-    PORTB = segment[segmentCounter]; // segment[0] = 0x3F
-    __delay_ms(100);                 // 100msec delay
-
-    LATAbits.LATA7 = 0; // buzzer - off
+    /*Display 0000 for STOP_DISPLAY_MS, then dark so the CPU can idle*/
+    Render_Set(RENDER_CLOCK, 0, 0, 0, 0, 0, 0);
+    Render_Poll(&render_segment);
+    if (!stop_display_shown)
+    {
+        stop_display_shown = 1;
+        stop_display_deadline = Tick_Get() + STOP_DISPLAY_MS;
+        SegMux_Enable(1);
+    }
+    Delay_ms(100);                 // 100msec delay
 }
 
 /*
  * @desc : display OVEr, when timer ends.
+ *         The alarm plays in the background and the message is cleared by
+ *         the idle loop, so buttons keep working straight away.
  * @params : none.
  */
 void stopMessage()
 {
-    unsigned int DEL;
-
     red_led(); // red led to indicate that timer is over.
 
-    LCD_Init((0x38 << 1));
+    LCD_CLR();
 
-    LCD_Set_Cursor(1, 7);
-    LCD_Write_String("OVER");
-    
-    __delay_ms(500);
+    Render_Invalidate(&render_lcd); // screen no longer holds the time
+    Render_Set(RENDER_OVER, 0, 0, 0, 0, 0, 0);
+    Render_Poll(&render_lcd);
+    Render_Poll(&render_segment); // OVEr on the digits too
+    SegMux_Enable(1);
 
-    LCD_CLR();
-    LATAbits.LATA7 = 0;
-       
+    over_message_shown = 1;
+    over_message_deadline = Tick_Get() + OVER_MESSAGE_MS;
 }
 
 /*
@@ -447,24 +422,16 @@ void stopMessage()
 void startUpcounter()
 {
     // display numbers from 0000 - 9999 on all displays.
-    seven_segment_config();
-    unsigned int displaypos, actualpos;
+    SegMux_Enable(1);
+
+    Buzzer_Play(&BUZZER_STARTUP); // one beep per digit step below
 
     for (segmentCounter = 0; segmentCounter < 2; segmentCounter++)
     {
-        LATAbits.LATA7 = 1; // buzzer - on
-
-        for (displaypos = 3; displaypos < 7; displaypos++)
-        {
-            actualpos = displaypos * 2;
-
-            lcd_print(1, actualpos, inttochar(segmentCounter)); /* print digit */
-            lcd_print(1, actualpos + 1, '.');                   /*print dot after a number*/
-        }
-        __delay_ms(500); /*500 milli-sec delay*/
-
-        LATAbits.LATA7 = 0; // buzzer - off
-        __delay_ms(500);    /*500 milli-sec delay*/
+        Render_Set(RENDER_SELFTEST, segmentCounter, segmentCounter, segmentCounter, segmentCounter, 0x0F, 0);
+        Render_Poll(&render_lcd); /* d.d.d.d. on the first row */
+        Render_Poll(&render_segment);
+        Delay_ms(1000); /*1 sec per step*/
     }
 
     LCD_CLR();
@@ -473,247 +440,305 @@ void startUpcounter()
    
 }
 
-/* EEPROM Function Definitions */
-
 /*
- * @desc: write data to eeprom.
- * @params : address, data.
- * @return : none.
+ * @desc : count up from 00.00 (minutes.seconds) with laps.
+ *         Button 3 takes a lap (in the tick interrupt, see stopwatch.c) and
+ *         the newest lap is shown on the second LCD row. Button 2 stops the
+ *         run, the laps are written to EEPROM in one batch, and then button 3
+ *         steps back through the held laps until button 2 leaves the mode.
+ * @params : none.
  */
-
-void EEPROM_Write(unsigned char address, unsigned char data)
+void startStopwatch()
 {
-    /*Write Operation*/
-    EEADR = address;      /* Write address to the EEADR register*/
-    EEDATA = data;        /* Copy data to the EEDATA register for write */
-    EECON1bits.EEPGD = 0; /* Access data EEPROM memory*/
-    EECON1bits.CFGS = 0;  /* Access flash program or data memory*/
-    EECON1bits.WREN = 1;  /* Allow write to the memory*/
-    INTCONbits.GIE = 0;   /* Disable global interrupt*/
-
-    /* Below sequence in EECON2 Register is necessary
-    to write data to EEPROM memory*/
-    EECON2 = 0x55;
-    EECON2 = 0xAA;
-
-    EECON1bits.WR = 1;  /* Start writing data to EEPROM memory*/
-    INTCONbits.GIE = 1; /* Enable interrupt*/
-
-    while (PIR2bits.EEIF == 0)
-        ;              /* Wait for write operation complete */
-    PIR2bits.EEIF = 0; /* Reset EEIF for further write operation */
-}
+    unsigned int lap_shown = 0;      // laps taken when row 2 was last drawn
+    unsigned char button2_held = 1;  // the press that started the run
+    unsigned char button3_held = 1;
+    unsigned char count, view;
+    unsigned int button_sample = Tick_Get(); // buttons are read every SW_DEBOUNCE_MS
 
-/*
- *@desc : read data from eeprom.
- *@params : address
- *@return : data
- *@return_type : char
- */
+    LCD_CLR();
+    Render_Invalidate(&render_lcd); // force the first LCD update
+    stopwatch_frame(0); // the scan must not start on the last frame
 
-char EEPROM_Read(unsigned char address)
-{
-    /*Read operation*/
-    EEADR = address;      /* Read data at location 0x00*/
-    EECON1bits.WREN = 0;  /* WREN bit is clear for Read operation*/
-    EECON1bits.EEPGD = 0; /* Access data EEPROM memory*/
-    EECON1bits.RD = 1;    /* To Read data of EEPROM memory set RD=1*/
-    return (EEDATA);
-}
+    Output_Relay(1); // LED panel on while counting
+    Output_RGB(OUT_DIM_GREEN);
+    Stopwatch_Start();
+    SegMux_Enable(1);
 
-/* Default display function definition */
-/*
- *@desc : display data in edit mode and update mode.
- *@params : buttonCounter, update.
- *@return : none
- */
-void display(unsigned int buttonCounter, unsigned int update)
-{
- 
-    display_function_count = display_function_count + 1; // Increment when this function is called.
-
-    unsigned char hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit;
-    unsigned int hour_f_digit, hour_s_digit, minute_f_digit, minute_s_digit;
-    
-    /* read stored hour and minute data from EEPROM */
-    /*
-    hour_first_digit = inttochar(EEPROM_Read(0x0A));    // read eeprom data at address location 0x0A
-    hour_second_digit = inttochar(EEPROM_Read(0x0B));   // read eeprom data at address location 0x0B
-    minute_first_digit = inttochar(EEPROM_Read(0x0C));  // read eeprom data at address location 0x0C
-    minute_second_digit = inttochar(EEPROM_Read(0x0D)); // read eeprom data at address location 0x0D
-    */
+    while (1)
+    {
+        stopwatch_frame(Stopwatch_Elapsed());
+        SegMux_Wake(); // full level while running, the review dims
 
-        /* display stored hour and minute data  */
-       LCD_Set_Cursor(1, 6); //cursor position for digit-1
-       
-        if (buttonCounter == 1)
+        if (Stopwatch_Lap_Total() != lap_shown)
         {
-            LCD_Write_Char(' ');
-             __delay_ms(200);
-        }else{
-            LCD_Write_Char(inttochar(EEPROM_Read(0x0A)));       
+            lap_shown = Stopwatch_Lap_Total();
+            lcd_show_lap(lap_shown, Stopwatch_Lap_Get(Stopwatch_Lap_Count() - 1));
+            Buzzer_Play(&BUZZER_KEY_CLICK);
         }
 
-        // digit 2
-        LCD_Set_Cursor(1, 8); // cursor position for digit-2
-       
-        if (buttonCounter == 2)
+        if (!Tick_Expired(button_sample))
+            continue; // the loop no longer waits on the digits, pace the buttons
+        button_sample = Tick_Get() + SW_DEBOUNCE_MS;
+
+        if (PORTCbits.RC1 == 0)
         {
-            LCD_Write_Char(' ');
-            __delay_ms(200);
-        }else{
-            LCD_Write_Char(inttochar(EEPROM_Read(0x0B)));
-            
-            //print dot
-            LCD_Set_Cursor(1,9);
-            LCD_Write_Char(':');
+            if (!button2_held)
+                break; // stop pressed
         }
+        else
+            button2_held = 0;
+    }
+
+    Stopwatch_Stop();
+    Output_Relay(0);
+    red_led();
+    Buzzer_Play(&BUZZER_ABORT);
+
+    Stopwatch_Flush(); // the only EEPROM writes of the run
+    Log_Append(LOG_STOPWATCH, 0, Stopwatch_Elapsed() / 1000);
+    log_view = 0;
 
-        // MINUTE DISPLAY
-        // digit 3
-         LCD_Set_Cursor(1, 10); //cursor position for digit-3
-         
-        if (buttonCounter == 3)
+    /* review : button 3 steps from the newest lap back to the oldest held one */
+    count = Stopwatch_Lap_Count();
+    view = count;
+    button2_held = 1;
+    while (1)
+    {
+        stopwatch_frame(Stopwatch_Elapsed());
+
+        if (!Tick_Expired(button_sample))
+            continue;
+        button_sample = Tick_Get() + SW_DEBOUNCE_MS;
+
+        if (PORTCbits.RC2 == 0)
         {
-            LCD_Write_Char(' ');
-            __delay_ms(200);
-        }else{
-            LCD_Write_Char(inttochar(EEPROM_Read(0x0C)));
+            if (!button3_held && count)
+            {
+                button3_held = 1;
+                view = (view > 1) ? view - 1 : count;
+                lcd_show_lap(Stopwatch_Lap_Total() - count + view, Stopwatch_Lap_Get(view - 1));
+                Buzzer_Play(&BUZZER_KEY_CLICK);
+            }
         }
+        else
+            button3_held = 0;
 
-        // digit 4
-        LCD_Set_Cursor(1, 12); // cursor position for digit-4
-        
-        if (buttonCounter == 4)
+        if (PORTCbits.RC1 == 0)
         {
-            LCD_Write_Char(' ');
-            __delay_ms(200);
-        }else{
-            LCD_Write_Char(inttochar(EEPROM_Read(0x0D)));
+            if (!button2_held)
+                break;
         }
+        else
+            button2_held = 0;
+    }
 
-        LATAbits.LATA7 = 0; // buzzer - off
+    while (PORTCbits.RC1 == 0)
+        ; // do not start a new run on the same press
 
-        
-        if ((display_function_count % 12 == 0) || (display_function_count % 6 == 0)) // once this condition passes, following digit will be visible..
-        {
-            switch (buttonCounter) // button counter
-            {
-            case 1:
-                LCD_Set_Cursor(1, 6);
-                LCD_Write_Char(inttochar(EEPROM_Read(0x0A)));
-                
-                __delay_ms(200);
-                break;
+    LCD_CLR();
+    Render_Invalidate(&render_lcd);
+    SegMux_Enable(0);
+}
 
-            case 2:
-                LCD_Set_Cursor(1, 8);
-                LCD_Write_Char(inttochar(EEPROM_Read(0x0B)));
+/*
+ * @desc : show the stopwatch, MM.SS on the digits and MM:SS on the first
+ *         LCD row. Minutes roll over after 99.
+ * @params : ms - elapsed time.
+ */
+void stopwatch_frame(unsigned long ms)
+{
+    unsigned int seconds = (unsigned int)(ms / 1000);
+    unsigned char minutes = (seconds / 60) % 100;
 
-                __delay_ms(200);
-                break;
+    seconds %= 60;
 
-            case 3:
-                LCD_Set_Cursor(1, 10);
-                LCD_Write_Char(inttochar(EEPROM_Read(0x0C)));
+    // dot on the second digit separates minutes and seconds
+    Render_Set(RENDER_CLOCK, minutes / 10, minutes % 10, seconds / 10, seconds % 10, 0x02, 0);
+    Render_Poll(&render_segment);
+    Render_Poll(&render_lcd);
+}
 
-                __delay_ms(200);
-                break;
+/*
+ * @desc : print "Lnn mm:ss.t" on the second LCD row.
+ * @params : number - lap number, ms - split time of the lap.
+ */
+void lcd_show_lap(unsigned int number, unsigned long ms)
+{
+    char text[11];
+    unsigned int seconds = (unsigned int)(ms / 1000);
+
+    text[0] = 'L';
+    Render_Format_Uint(&text[1], number, 2);
+    text[3] = ' ';
+    Render_Format_Uint(&text[4], seconds / 60, 2); // minutes roll over after 99
+    text[6] = ':';
+    Render_Format_Uint(&text[7], seconds % 60, 2);
+    text[9] = '.';
+    Render_Format_Uint(&text[10], (unsigned int)(ms % 1000) / 100, 1);
+
+    LCD_Write_Field(2, 3, text, sizeof(text));
+}
 
-            case 4:
-                LCD_Set_Cursor(1, 12);
-                LCD_Write_Char(inttochar(EEPROM_Read(0x0D)));
+/*
+ * @desc : print run n of the log on the second LCD row, 0 = newest.
+ *         "nn HH:MM E MM:SS" : set time, E(xpired) A(borted) S(topwatch),
+ *         time actually run (HHhMM from one hour on).
+ * @params : n - log entry.
+ */
+void lcd_show_log(unsigned char n)
+{
+    static const char reason[] = "EAS";
+    char text[16];
+    Log_Entry entry;
+    unsigned int a, b;
 
-                __delay_ms(200);
-                break;
+    if (!Log_Get(n, &entry))
+    {
+        LCD_Write_Field(2, 1, "no runs logged  ", 16);
+        return;
+    }
 
-            default:
-                break;
-            } // end switch statement.
-        }     // end if statement.
+    Render_Format_Uint(&text[0], n + 1, 2);
+    text[2] = ' ';
+    Render_Format_Uint(&text[3], entry.duration / 60, 2);
+    text[5] = ':';
+    Render_Format_Uint(&text[6], entry.duration % 60, 2);
+    text[8] = ' ';
+    text[9] = reason[entry.reason];
+    text[10] = ' ';
 
-    // Update digits.
-    if (update && (display_function_count % 2 == 0))
+    if (entry.elapsed < 3600)
     {
-        switch (buttonCounter)
-        {
-        case 1:
-            hour_f_digit = EEPROM_Read(0x0A) + 1; // increment the value
-            
-            if (hour_f_digit > 9)
-                hour_f_digit = 0;             // if it exceeds 9, reset it to 0.
-            EEPROM_Write(0x0A, hour_f_digit); // update and store the value in eeprom
-            __delay_ms(50);
-            break;
-        case 2:
-            hour_s_digit = EEPROM_Read(0x0B) + 1; // increment the value
-            
-            if (hour_s_digit > 9)
-                hour_s_digit = 0;             // if it exceeds 9, reset it to 0.
-            EEPROM_Write(0x0B, hour_s_digit); // update and store the value in eeprom
-            __delay_ms(50);
-            break;
-        case 3:
-            minute_f_digit = EEPROM_Read(0x0C) + 1; // increment the value
-            
-            if (minute_f_digit > 5)
-                minute_f_digit = 0;             // if it exceeds 5, reset it to 0.
-            EEPROM_Write(0x0C, minute_f_digit); // update and store the value in eeprom
-            __delay_ms(50);
-            break;
-        case 4:
-            minute_s_digit = EEPROM_Read(0x0D) + 1; // increment the value
-            
-            if (minute_s_digit > 9)
-                minute_s_digit = 0;             // if it exceeds 9, reset it to 0.
-            EEPROM_Write(0x0D, minute_s_digit); // update and store the value in eeprom
-            __delay_ms(50);
-            break;
-        default:
-            break;
-        }
+        a = entry.elapsed / 60; // minutes : seconds
+        b = entry.elapsed % 60;
+        text[13] = ':';
     }
-        
-       
-    // reset display function counter.
-    if (display_function_count > 1000)
-        display_function_count = 0;
+    else
+    {
+        a = (entry.elapsed / 3600) % 100; // hours h minutes
+        b = (entry.elapsed / 60) % 60;
+        text[13] = 'h';
+    }
+    Render_Format_Uint(&text[11], a, 2);
+    Render_Format_Uint(&text[14], b, 2);
+
+    LCD_Write_Field(2, 1, text, sizeof(text));
 }
 
+/* Default display function definition */
 /*
- *@desc : converts type (int to char)
+ *@desc : display the stored time in normal mode.
+ *        The LCD is only written when the stored digits changed.
+ *@return : none
  */
-unsigned char inttochar(unsigned int digit)
+void display()
 {
-    /*
-     * ASCII representation of 0 is 48, any digit added to 48 will be char representation of that number.
-     */
-    return digit + '0';
+    Render_Set(RENDER_CLOCK, EEPROM_Read(EE_HOUR_FIRST), EEPROM_Read(EE_HOUR_SECOND),
+               EEPROM_Read(EE_MINUTE_FIRST), EEPROM_Read(EE_MINUTE_SECOND), 0, 0);
+    Render_Poll(&render_lcd);
+
+    INVARIANT(digits_valid(EEPROM_Read(EE_HOUR_FIRST), EEPROM_Read(EE_HOUR_SECOND),
+                           EEPROM_Read(EE_MINUTE_FIRST), EEPROM_Read(EE_MINUTE_SECOND)), INV_DIGITS_STORED);
 }
 
 /*
- * @desc : Collective function to display some character on lcd.
+ *@desc : debounced button state. The pins are sampled at most every
+ *        BUTTON_DEBOUNCE_MS, so a contact bounce never reads as a second press.
+ *@return : BUTTON_1 | BUTTON_2 | BUTTON_3 for the buttons held down.
  */
-void lcd_print(unsigned char row, unsigned char col, char Data)
+unsigned char buttons_read()
 {
-    /*
-     * 1. Set cursor.
-     * 2. Print
-     */
-    LCD_Set_Cursor(row, col); /* set cursor */
-    LCD_Write_Char(Data);     /*write data*/
+    static unsigned char state;
+    static unsigned int sampled_at;
+
+    if ((unsigned int)(Tick_Get() - sampled_at) >= BUTTON_DEBOUNCE_MS) // stays right however long a run kept us away
+    {
+        sampled_at = Tick_Get();
+        state = (unsigned char)~PORTC & (BUTTON_1 | BUTTON_2 | BUTTON_3);
+    }
+    return state;
+}
+
+/*
+ *@desc : enter edit mode with the stored time in the RAM buffer.
+ */
+void edit_begin()
+{
+    edit_time = ((unsigned int)EEPROM_Read(EE_HOUR_FIRST) << 12) | ((unsigned int)EEPROM_Read(EE_HOUR_SECOND) << 8) |
+                (EEPROM_Read(EE_MINUTE_FIRST) << 4) | EEPROM_Read(EE_MINUTE_SECOND);
+    edit_changed_at = Tick_Get() - EDIT_LIT_MS;
+    SegMux_Enable(1); // the digits follow the edit too
+}
+
+/*
+ *@desc : leave edit mode. The buffer is written back here and nowhere
+ *        else, and digits that did not change are not rewritten.
+ */
+void edit_end()
+{
+    INVARIANT(digits_valid(edit_time >> 12, (edit_time >> 8) & 0x0F, (edit_time >> 4) & 0x0F, edit_time & 0x0F), INV_EDIT_DIGITS);
+
+    EEPROM_Update(EE_HOUR_FIRST, edit_time >> 12);
+    EEPROM_Update(EE_HOUR_SECOND, (edit_time >> 8) & 0x0F);
+    EEPROM_Update(EE_MINUTE_FIRST, (edit_time >> 4) & 0x0F);
+    EEPROM_Update(EE_MINUTE_SECOND, edit_time & 0x0F);
+    SegMux_Enable(0);
+}
+
+/*
+ *@desc : add one to a digit of the buffer, wrapping to 0 past its limit,
+ *        and show the result straight away.
+ *@params : field - 1..4, left to right.
+ */
+void edit_step(uint8_t field)
+{
+    const Edit_Field *f = &edit_fields[field - 1];
+    unsigned char digit = (edit_time >> f->shift) & 0x0F;
+
+    digit = (digit >= f->max) ? 0 : digit + 1;
+    edit_time = (edit_time & ~(0x0FU << f->shift)) | ((unsigned int)digit << f->shift);
+
+    edit_changed_at = Tick_Get();
+    edit_show(field);
+}
+
+/*
+ *@desc : publish the buffer to both displays. The edited digit blinks,
+ *        except right after a change so the new value can be read.
+ *@params : field - 1..4, digit being edited.
+ */
+void edit_show(uint8_t field)
+{
+    uint8_t blank = 0;
+
+    if ((unsigned int)(Tick_Get() - edit_changed_at) >= EDIT_LIT_MS && (Tick_Get() & EDIT_BLINK_MASK))
+        blank = 1 << (field - 1);
+
+    Render_Set(RENDER_CLOCK, edit_time >> 12, (edit_time >> 8) & 0x0F, (edit_time >> 4) & 0x0F, edit_time & 0x0F, 0, blank);
+    Render_Poll(&render_lcd); // the bus is only used when the digit or blink phase changed
+    Render_Poll(&render_segment);
+}
+
+/*
+ * @desc : check a set of time digits : hours 0-9 0-9, minutes 0-5 0-9.
+ * @return : 1 when every digit is in range.
+ */
+unsigned char digits_valid(int8_t h1, int8_t h2, int8_t m1, int8_t m2)
+{
+    return h1 >= 0 && h1 <= 9 && h2 >= 0 && h2 <= 9 && m1 >= 0 && m1 <= 5 && m2 >= 0 && m2 <= 9;
 }
 
 
 void EEPROM_Mem_Initialise(){
     unsigned char eeprom_addr, flag_addr = 0x0F; //address location
-    unsigned int mem_check = 0, i = 1;
+    uint8_t mem_check = 0;
     
-    __delay_ms(1000);
+    Delay_ms(1000);
     
     //below loop will continue until faulty reading 
     while((EEPROM_Read(0x0A) == 0) && (EEPROM_Read(0x0B) == 0) && (EEPROM_Read(0x0C) == 0) && (EEPROM_Read(0x0D) == 0) && (EEPROM_Read(0x0F) == 0)){
-            __delay_ms(500);
+            Delay_ms(500);
     }
         
     if(EEPROM_Read(0x0F) == 1)
@@ -723,14 +748,14 @@ void EEPROM_Mem_Initialise(){
         
         for(eeprom_addr = 0x0A; eeprom_addr < 0x0E; eeprom_addr++){
             EEPROM_Write(eeprom_addr, 0);
-            __delay_ms(20);                        
+            Delay_ms(20);                        
         }
         
         EEPROM_Write(flag_addr, 1);
-         __delay_ms(20);
+         Delay_ms(20);
     }
     
-     __delay_ms(1000);
+     Delay_ms(1000);
 }
 
 /*
@@ -738,10 +763,12 @@ void EEPROM_Mem_Initialise(){
  */
 void main(void)
 {
+    unsigned long resume_seconds;
+    unsigned long resume_total;
+    unsigned char resume_relay;
 
-    // Configure the oscillator(64MHz using PLL)
-    OSCCON = 0x70;  // 0b01110000
-    OSCTUNE = 0xC0; // 0b11000000
+    // Configure the oscillator(64MHz using PLL), lowered later when idle
+    Clock_Set(CLOCK_64MHZ);
 
     // Configure the button pins
     TRISCbits.TRISC0 = 1;
@@ -751,31 +778,52 @@ void main(void)
     // Configure the input pins as digital.
     ANSELCbits.ANSC2 = 0;
 
-    // Configure the digital pins (RGB LED))
-    TRISAbits.TRISA4 = 0; // led 1
-    TRISAbits.TRISA5 = 0; // led 2
-    TRISAbits.TRISA6 = 0; // led 3
-
-    TRISAbits.TRISA7 = 0; // buzzer
-    TRISCbits.TRISC3 = 0; // relay
+    // RGB LED, buzzer and relay : all off by default
+    Output_Init();
+    Buzzer_Init();
 
-    /*By default all LEDs should be off*/
-    LATAbits.LATA4 = 1;
-    LATAbits.LATA5 = 1;
-    LATAbits.LATA6 = 1;
+    // countdown cut by a power fail : the LED panel comes back before anything slow
+    resume_seconds = Checkpoint_Load(&resume_relay, &resume_total);
+    if (resume_seconds)
+        Output_Relay(resume_relay);
 
-    LATCbits.LATC3 = 0; // initially relay should be off.
+    /*1 ms tick for the background drivers*/
+    Tick_Init();
+    INTCONbits.PEIE = 1; // peripheral interrupts : HLVD checkpoint, Timer4 tick, Timer2 display scan
+    INTCONbits.GIE = 1;
     
     /*I2C and LCD Initialisation*/
+#if I2C_TRACE
+    I2C_Trace_Init();
+#endif
     I2C2_Init();
+#if I2C_BUS1_ENABLE
+    I2C1_Init(); // second bus for sensors / RTC, independent of the LCD
+#endif
 
-    LCD_Init((0x38 << 1)); // Initialize LCD module with I2C address = 0x38
+    LCD_Init(LCD_Find_Address()); // Initialize LCD module at the detected (or cached) I2C address
 
-    /*Start Initial Counter*/
-    startUpcounter();
-   
-    __delay_ms(1000);
-    EEPROM_Mem_Initialise();
+    RTC_Init(); // 1 Hz time base for the countdown (tick based if no RTC is fitted)
+
+    SegMux_Init(); // segment lines on PORTB (b/c shared with the i2c pins), digits on RA0-RA3
+
+    Checkpoint_Init(); // low voltage detect for the countdown checkpoint
+    Log_Init();        // find the end of the run log
+
+    if (resume_seconds)
+    {
+        resumeTimer(resume_seconds, resume_total); // fast path : no self test, EEPROM already initialised
+    }
+    else
+    {
+        /*Start Initial Counter*/
+        startUpcounter();
+
+        Delay_ms(1000);
+        EEPROM_Mem_Initialise();
+        INVARIANT(EEPROM_Read(EE_INIT_FLAG) == 1 && digits_valid(EEPROM_Read(EE_HOUR_FIRST), EEPROM_Read(EE_HOUR_SECOND),
+                                                                 EEPROM_Read(EE_MINUTE_FIRST), EEPROM_Read(EE_MINUTE_SECOND)), INV_EEPROM_INIT);
+    }
     
     /*EEPROM - LCD Write Read Test*/
     /*
@@ -791,45 +839,65 @@ void main(void)
     LCD_Write_Char(test_var); //display data at 0x0F.
     */
   
-    unsigned int isEditMode = 0;
-    unsigned int shiftCounter = 1;
-    unsigned int stop_flag = 0;
-    unsigned int updateFlag = 0;
-    unsigned int transition_start_counter = 0;
-    unsigned int transition_end_counter = 0;
-    unsigned char hour_first_digit, hour_second_digit, minute_first_digit, minute_second_digit;
+    uint8_t isEditMode = 0;
+    uint8_t shiftCounter = 1;
+    uint8_t stop_flag = 0;
+    uint8_t transition_start_counter = 0;
+    uint8_t transition_end_counter = 0;
+    uint8_t lcd_check_counter = 0;
+    unsigned char buttons, pressed, buttons_last = 0;
+    unsigned int repeat_deadline = 0;
+    unsigned int repeat_interval = EDIT_REPEAT_SLOW_MS;
+    unsigned int idle_refresh_deadline = Tick_Get();
 
     while (1)
     {
-        if (PORTCbits.RC0 == 0) // button 1 clicked
+        buttons = buttons_read();
+        pressed = buttons & (unsigned char)~buttons_last; // went down since the last pass
+        buttons_last = buttons;
+
+        if (buttons)
         {
-            LATAbits.LATA7 = 1; // buzzer - on
+            Clock_Set(CLOCK_RUN); // a button wakes the CPU up
+            SegMux_Wake();        // and the digits back to full level
+        }
+        if (pressed)
+        {
+            Buzzer_Stop();                  // a press silences the alarm
+            Buzzer_Play(&BUZZER_KEY_CLICK); // one click per press
+        }
 
-            isEditMode ^= 1; // toggle
-            stop_flag = 0;   // reset stop flag.
+        if (buttons & BUTTON_1) // button 1 clicked
+        {
+            if (pressed & BUTTON_1)
+            {
+                isEditMode ^= 1; // toggle
+                stop_flag = 0;   // reset stop flag.
 
-            LATAbits.LATA7 = 0; // buzzer - off
+                if (isEditMode)
+                    edit_begin();
+                else
+                    edit_end(); // the only EEPROM write of an edit
+            }
         }
-        else if (PORTCbits.RC1 == 0) // button 2 clicked
+        else if (buttons & BUTTON_2) // button 2 clicked
         {
-            LATAbits.LATA7 = 1; // buzzer - on
-
-            updateFlag = 0; // clear updateFlag
             stop_flag = 0;  // clear stop flag.
 
             if (isEditMode)
             { // edit mode
 
-                __delay_ms(100); // delay for button press.
-
-                if (shiftCounter < 4) // if button shift is less than 4, increment.
-                    shiftCounter++;
-                else
-                    shiftCounter = 1; // equals to 4 or greater than 4, reset the counter to 1.
+                if (pressed & BUTTON_2)
+                {
+                    if (shiftCounter < 4) // if button shift is less than 4, increment.
+                        shiftCounter++;
+                    else
+                        shiftCounter = 1; // equals to 4 or greater than 4, reset the counter to 1.
 
-                display(shiftCounter, updateFlag); // display stored time, shift displays.
+                    edit_show(shiftCounter); // display stored time, shift displays.
+                }
             }
-            else
+            else if (pressed & BUTTON_2)
             {
                 //@TODO : We have to add transition mode. (on long press)
                 /*
@@ -848,21 +916,48 @@ void main(void)
                 // 3. relay off
                 // 4. time ends indication.
 
-                startTimer(); // start timer.
+                // a stored time of 00:00 has nothing to count down, count up instead.
+                if ((EEPROM_Read(EE_HOUR_FIRST) | EEPROM_Read(EE_HOUR_SECOND) | EEPROM_Read(EE_MINUTE_FIRST) | EEPROM_Read(EE_MINUTE_SECOND)) == 0)
+                    startStopwatch();
+                else
+                    startTimer(); // start timer.
+
+                // a button still down from the run (button 3 aborts it) is no new press
+                buttons_last = BUTTON_1 | BUTTON_2 | BUTTON_3;
             }
         }
-        else if (PORTCbits.RC2 == 0) // button 3 clicked
+        else if (buttons & BUTTON_3) // button 3 clicked
         {
-            LATAbits.LATA7 = 1;           // buzzer - on
             transition_start_counter = 0; // reset transition start counter.
 
             if (isEditMode)
-            {                                      // edit mode
-                updateFlag = 1;                    // set update flag.
-                display(shiftCounter, updateFlag); // increment digits of the respective display.
+            { // edit mode : step on the press, then repeat while held
+                if (pressed & BUTTON_3)
+                {
+                    edit_step(shiftCounter);
+                    repeat_interval = EDIT_REPEAT_SLOW_MS;
+                    repeat_deadline = Tick_Get() + EDIT_REPEAT_DELAY_MS;
+                }
+                else if (Tick_Expired(repeat_deadline))
+                {
+                    edit_step(shiftCounter);
+                    repeat_deadline = Tick_Get() + repeat_interval;
+                    repeat_interval -= repeat_interval >> 2; // accelerate
+                    if (repeat_interval < EDIT_REPEAT_FAST_MS)
+                        repeat_interval = EDIT_REPEAT_FAST_MS;
+                }
             }
             else
             {
+                if (pressed & BUTTON_3)
+                {
+                    // each press shows the next older run on row 2
+                    lcd_show_log(log_view);
+                    if (++log_view >= Log_Count())
+                        log_view = 0;
+                    stop_display_shown = 0; // and 0000 for another STOP_DISPLAY_MS
+                }
+
                 stop_flag = 1;
 
                 // normal mode.
@@ -874,27 +969,56 @@ void main(void)
         {
             transition_start_counter = 0; // reset transition start counter.
 
-            if (isEditMode == 0) // normal mode
+            if (isEditMode == 0 && !Tick_Expired(idle_refresh_deadline))
+            {
+                // nothing to do but poll the buttons, the digit scan needs CLOCK_RUN
+                Clock_Set(SegMux_Enabled() ? CLOCK_RUN : CLOCK_IDLE);
+            }
+            else if (isEditMode == 0) // normal mode
             {
+                idle_refresh_deadline = Tick_Get() + IDLE_REFRESH_MS;
+                Clock_Set(CLOCK_BURST); // LCD and EEPROM work, done quickly
+
                 red_led(); // set up bits to turn on red led.
 
-                if (stop_flag)
+                Log_Service(); // runs finished since the last pass
+
+                if (over_message_shown)
                 {
-                    stopTimer(); // stop timer
+                    if (Tick_Expired(over_message_deadline))
+                    {
+                        over_message_shown = 0;
+                        LCD_CLR(); // OVER has been up long enough
+                        Render_Invalidate(&render_lcd);
+                        SegMux_Enable(0);
+                    }
                 }
                 else
                 {
-                    display(0, 0); // display stored time in normal mode.
+                    if (stop_flag)
+                        stopTimer(); // stop timer
+                    else
+                        display(); // display stored time in normal mode.
+
+                    // also after an abort, which leaves stop_flag clear
+                    if (stop_display_shown && Tick_Expired(stop_display_deadline))
+                        SegMux_Enable(0); // 0000 has been up long enough
                 }
+
+                if (++lcd_check_counter >= LCD_CHECK_PERIOD)
+                {
+                    lcd_check_counter = 0;
+                    LCD_Check(); // repair a garbled LCD in place
+                }
+
+                Clock_Set(SegMux_Enabled() ? CLOCK_RUN : CLOCK_IDLE);
             }
             else // edit mode
             {
-                updateFlag = 0;                    // clear updateFlag
-                blue_led();                        // set up bits to turn on blue led.
-                display(shiftCounter, updateFlag); // display stored data in edit mode.
+                Clock_Set(CLOCK_RUN);
+                blue_led();              // set up bits to turn on blue led.
+                edit_show(shiftCounter); // blink the digit being edited.
             }
-
-            LATAbits.LATA7 = 0; // buzzer - off
         }
     }
 
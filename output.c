@@ -0,0 +1,113 @@
+/*
+ * File:   output.c
+ *
+ * Shadow-latched outputs : RGB status LED, relay and buzzer.
+ */
+
+#include <xc.h>
+#include "output.h"
+
+/* Duty of each channel in PWM steps : red, green, blue */
+static const unsigned char out_colour[OUT_COLOURS][3] = {
+    {0, 0, 0},                          // OUT_OFF
+    {OUT_PWM_STEPS, 0, 0},              // OUT_RED
+    {0, OUT_PWM_STEPS, 0},              // OUT_GREEN
+    {0, 0, OUT_PWM_STEPS},              // OUT_BLUE
+    {OUT_PWM_STEPS, 3, 0},              // OUT_AMBER
+    {0, 2, 0},                          // OUT_DIM_GREEN
+};
+
+static volatile unsigned char out_rgb = OUT_OFF;    // requested colour
+static unsigned char out_rgb_lat = OUT_RGB_MASK;    // RGB bits last written (all off)
+static unsigned char out_pwm_phase;
+static unsigned char out_relay;
+static unsigned char out_buzzer;
+
+/*******************************************************************************
+ * Function:        void Output_Init(void)
+ * Description:     LED, relay and buzzer pins as outputs, everything off
+ ******************************************************************************/
+void Output_Init(void){
+    TRISA &= (unsigned char)~(OUT_RGB_MASK | 0x80);
+    RELAY_TRIS = 0;
+
+    LATA |= OUT_RGB_MASK;               // common anode : high is off
+    out_rgb_lat = OUT_RGB_MASK;
+    out_rgb = OUT_OFF;
+
+    OUT_BUZZER_LAT = 0;
+    out_buzzer = 0;
+    RELAY_LAT = 0;
+    out_relay = 0;
+}
+
+/*******************************************************************************
+ * Function:        void Output_RGB(unsigned char colour)
+ * Description:     Selects the status LED colour (OUT_RED, OUT_AMBER, ...)
+ * Remarks:         Only the shadow is written, the tick drives the pins
+ ******************************************************************************/
+void Output_RGB(unsigned char colour){
+    if(colour < OUT_COLOURS)
+        out_rgb = colour;
+}
+
+/*******************************************************************************
+ * Function:        void Output_Relay(unsigned char on)
+ * Description:     Relay (LED panel) on or off, the pin is written on change
+ ******************************************************************************/
+void Output_Relay(unsigned char on){
+    on = on ? 1 : 0;
+    if(on != out_relay){
+        out_relay = on;
+        RELAY_LAT = on;
+    }
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Output_Relay_State(void)
+ * Description:     Relay state as last set, without reading the port
+ ******************************************************************************/
+unsigned char Output_Relay_State(void){
+    return out_relay;
+}
+
+/*******************************************************************************
+ * Function:        void Output_Buzzer(unsigned char on)
+ * Description:     Buzzer on or off, the pin is written on change
+ ******************************************************************************/
+void Output_Buzzer(unsigned char on){
+    on = on ? 1 : 0;
+    if(on != out_buzzer){
+        out_buzzer = on;
+        OUT_BUZZER_LAT = on;
+    }
+}
+
+/*******************************************************************************
+ * Function:        void Output_Tick(unsigned char ms)
+ * Description:     PWM step of the RGB LED
+ * Precondition:    Called from the interrupt routine on every tick
+ * Parameters:      ms = milliseconds since the last call
+ * Return Values:   None
+ * Remarks:         LATA is only written when a channel changes state. With
+ *                  the 4 ms tick of CLOCK_IDLE only every 4th step is seen,
+ *                  which is exact for the full colours used while idle.
+ ******************************************************************************/
+void Output_Tick(unsigned char ms){
+    const unsigned char *duty = out_colour[out_rgb];
+    unsigned char lat = OUT_RGB_MASK;
+
+    out_pwm_phase = (out_pwm_phase + ms) & (OUT_PWM_STEPS - 1);
+
+    if(duty[0] > out_pwm_phase)
+        lat &= (unsigned char)~OUT_RED_BIT;
+    if(duty[1] > out_pwm_phase)
+        lat &= (unsigned char)~OUT_GREEN_BIT;
+    if(duty[2] > out_pwm_phase)
+        lat &= (unsigned char)~OUT_BLUE_BIT;
+
+    if(lat != out_rgb_lat){
+        out_rgb_lat = lat;
+        LATA = (LATA & (unsigned char)~OUT_RGB_MASK) | lat;
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * File:   output.h
+ *
+ * Shadow-latched outputs : RGB status LED, relay and buzzer.
+ * Pins are only written when their state changes; the RGB LED colours are
+ * mixed by time-slicing the three channels on the 1 ms tick.
+ */
+
+#ifndef OUTPUT_H
+#define	OUTPUT_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+#include "i2c.h"
+
+/*********** P O R T   D E F I N E S ******************************************/
+/* RGB LED, common anode : a low pin lights the channel */
+#define OUT_GREEN_BIT   0x10            // RA4
+#define OUT_RED_BIT     0x20            // RA5
+#define OUT_BLUE_BIT    0x40            // RA6
+#define OUT_RGB_MASK    (OUT_GREEN_BIT | OUT_RED_BIT | OUT_BLUE_BIT)
+
+#define OUT_BUZZER_LAT  LATAbits.LATA7
+
+/* Relay pin : RC3 is SCK1, so the relay moves to RC5 when MSSP1 is in use */
+#if I2C_BUS1_ENABLE
+#define RELAY_LAT LATCbits.LATC5
+#define RELAY_TRIS TRISCbits.TRISC5
+#else
+#define RELAY_LAT LATCbits.LATC3
+#define RELAY_TRIS TRISCbits.TRISC3
+#endif
+
+/*********** C O L O U R S ****************************************************/
+#define OUT_PWM_STEPS   8               // 8 ms PWM frame, 125 Hz, a power of 2
+
+#define OUT_OFF         0
+#define OUT_RED         1
+#define OUT_GREEN       2
+#define OUT_BLUE        3
+#define OUT_AMBER       4               // last minute of a countdown
+#define OUT_DIM_GREEN   5               // countdown running
+#define OUT_COLOURS     6
+
+/*********** P R O T O T Y P E S **********************************************/
+void Output_Init(void);
+void Output_RGB(unsigned char colour);
+void Output_Relay(unsigned char on);
+unsigned char Output_Relay_State(void);
+void Output_Buzzer(unsigned char on);
+void Output_Tick(unsigned char ms);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* OUTPUT_H */
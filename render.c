@@ -0,0 +1,193 @@
+/*
+ * File:   render.c
+ *
+ * Render layer : one display model, pulled by the LCD and 7 segment backends.
+ */
+
+#include <xc.h>
+#include "render.h"
+#include "lcd.h"
+
+const unsigned char segment[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+const unsigned char segment_with_dot[10] = {0xBF, 0x86, 0xDB, 0xCF, 0xE6, 0xED, 0xFD, 0x87, 0xFF, 0xEF};
+
+static const unsigned char render_over_segments[RENDER_DIGITS] = {0x3F, 0x3E, 0x79, 0x50}; // O V E r
+static const char render_bcd_char[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', ' ', ' ', ' ', ' ', ' ', ' '};
+static const unsigned int render_pow10[5] = {10000, 1000, 100, 10, 1};
+
+static Render_Model render_model;
+static unsigned char render_version = 1;
+
+static void Render_LCD_Draw(const Render_Model *model);
+static void Render_Segment_Draw(const Render_Model *model);
+
+Render_Backend render_lcd = {Render_LCD_Draw, 0};
+Render_Backend render_segment = {Render_Segment_Draw, 0};
+unsigned char render_segment_frame[RENDER_DIGITS];
+
+/*******************************************************************************
+ * Function:        unsigned char Render_Format_BCD(char *Buf, unsigned int Bcd,
+ *                                                  const char *Layout)
+ * Description:     Fills a fixed width field from packed BCD digits
+ * Precondition:    None
+ * Parameters:      Buf = output, as long as Layout, not terminated
+ *                  Bcd = up to 4 digits, most significant nibble first,
+ *                        RENDER_BCD_BLANK shows as a space
+ *                  Layout = text of the field, each '#' takes the next digit
+ * Return Values:   Characters written
+ * Remarks:         One table lookup per digit, no divisions
+ ******************************************************************************/
+unsigned char Render_Format_BCD(char *Buf, unsigned int Bcd, const char *Layout){
+    unsigned char n = 0;
+
+    while(*Layout){
+        if(*Layout == '#'){
+            Buf[n] = render_bcd_char[(Bcd >> 12) & 0x0F];
+            Bcd <<= 4;
+        }else{
+            Buf[n] = *Layout;
+        }
+        Layout++;
+        n++;
+    }
+    return n;
+}
+
+/*******************************************************************************
+ * Function:        void Render_Format_Uint(char *Buf, unsigned int Value,
+ *                                          unsigned char Width)
+ * Description:     Writes the Width low decimal digits of Value, zero padded
+ * Precondition:    None
+ * Parameters:      Buf = output, Width characters, not terminated
+ *                  Value = number to show, higher digits are dropped
+ *                  Width = 1..5
+ * Return Values:   None
+ * Remarks:         Digits come from subtracting powers of ten, the PIC18 has
+ *                  no divide instruction and a 16 bit / or % is a library call
+ ******************************************************************************/
+void Render_Format_Uint(char *Buf, unsigned int Value, unsigned char Width){
+    unsigned char i;
+    char digit;
+
+    for(i = 0; i < 5; i++){
+        digit = '0';
+        while(Value >= render_pow10[i]){
+            Value -= render_pow10[i];
+            digit++;
+        }
+        if(i >= 5 - Width)
+            *Buf++ = digit;
+    }
+}
+
+/*******************************************************************************
+ * Function:        void Render_Publish(const Render_Model *model)
+ * Description:     Makes model the one every backend shows
+ * Precondition:    None
+ * Parameters:      model = new display content
+ * Return Values:   None
+ * Remarks:         The version only moves when the content differs, so
+ *                  publishing the same time every pass costs no redraw
+ ******************************************************************************/
+void Render_Publish(const Render_Model *model){
+    const unsigned char *a = (const unsigned char *)model;
+    unsigned char *b = (unsigned char *)&render_model;
+    unsigned char i, changed = 0;
+
+    for(i = 0; i < sizeof(Render_Model); i++){
+        if(a[i] != b[i]){
+            b[i] = a[i];
+            changed = 1;
+        }
+    }
+    if(changed)
+        render_version++;
+}
+
+/*******************************************************************************
+ * Function:        void Render_Set(unsigned char mode, unsigned char d0, ...)
+ * Description:     Builds a model and publishes it
+ * Precondition:    None
+ * Parameters:      mode = RENDER_*, d0..d3 = digits left to right,
+ *                  dots / blank = bit per digit, bit 0 is d0
+ * Return Values:   None
+ * Remarks:         None
+ ******************************************************************************/
+void Render_Set(unsigned char mode, unsigned char d0, unsigned char d1, unsigned char d2,
+                unsigned char d3, unsigned char dots, unsigned char blank){
+    Render_Model model;
+
+    model.mode = mode;
+    model.digit[0] = d0;
+    model.digit[1] = d1;
+    model.digit[2] = d2;
+    model.digit[3] = d3;
+    model.dots = dots;
+    model.blank = blank;
+    Render_Publish(&model);
+}
+
+/*******************************************************************************
+ * Function:        void Render_Poll(Render_Backend *backend)
+ * Description:     Draws the model on one backend if it changed since its last draw
+ ******************************************************************************/
+void Render_Poll(Render_Backend *backend){
+    if(backend->version == render_version)
+        return;
+    backend->version = render_version;
+    backend->draw(&render_model);
+}
+
+/*******************************************************************************
+ * Function:        void Render_Invalidate(Render_Backend *backend)
+ * Description:     Forces the next poll to draw, after the screen was cleared
+ ******************************************************************************/
+void Render_Invalidate(Render_Backend *backend){
+    backend->version = render_version - 1;
+}
+
+/*
+ * LCD backend, one field on the first row from RENDER_LCD_COL :
+ *   clock      "H H:M M"   (blank digits as spaces)
+ *   over       " OVER  "
+ *   selftest   "d.d.d.d."
+ */
+static void Render_LCD_Draw(const Render_Model *model){
+    char text[8];
+    unsigned int bcd = 0;
+    unsigned char i;
+
+    if(model->mode == RENDER_OVER){
+        LCD_Write_Field(RENDER_LCD_ROW, RENDER_LCD_COL, " OVER  ", 7);
+        return;
+    }
+
+    for(i = 0; i < RENDER_DIGITS; i++)
+        bcd = (bcd << 4) | ((model->blank & (1 << i)) ? RENDER_BCD_BLANK : model->digit[i]);
+
+    if(model->mode == RENDER_SELFTEST)
+        i = Render_Format_BCD(text, bcd, "#.#.#.#.");
+    else
+        i = Render_Format_BCD(text, bcd, "# #:# #");
+    LCD_Write_Field(RENDER_LCD_ROW, RENDER_LCD_COL, text, i);
+}
+
+/*
+ * 7 segment backend : segment codes into render_segment_frame for the
+ * multiplexer, so the table lookups happen once per change instead of
+ * once per digit per frame.
+ */
+static void Render_Segment_Draw(const Render_Model *model){
+    unsigned char i;
+
+    for(i = 0; i < RENDER_DIGITS; i++){
+        if(model->mode == RENDER_OVER)
+            render_segment_frame[i] = render_over_segments[i];
+        else if(model->blank & (1 << i))
+            render_segment_frame[i] = 0x00;
+        else if((model->dots & (1 << i)) || model->mode == RENDER_SELFTEST)
+            render_segment_frame[i] = segment_with_dot[model->digit[i]];
+        else
+            render_segment_frame[i] = segment[model->digit[i]];
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * File:   render.h
+ *
+ * Render layer : the application publishes one display model, and each
+ * display backend pulls it at its own pace.
+ */
+
+#ifndef RENDER_H
+#define	RENDER_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+#define RENDER_DIGITS       4
+
+/* Modes */
+#define RENDER_CLOCK        0           // d0 d1 : d2 d3 (HH:MM or MM:SS)
+#define RENDER_OVER         1           // countdown finished
+#define RENDER_SELFTEST     2           // d.d.d.d. power on count
+
+/* Packed BCD digit value shown as a space by Render_Format_BCD */
+#define RENDER_BCD_BLANK    0x0F
+
+/* Where the LCD backend draws */
+#define RENDER_LCD_ROW      1
+#define RENDER_LCD_COL      6
+
+/*
+ * The model carries a version that moves on every change. A backend keeps
+ * the version it last drew and does nothing while it matches, so polling is
+ * a compare, and a slow backend simply skips the versions it missed.
+ */
+typedef struct {
+    unsigned char mode;
+    unsigned char digit[RENDER_DIGITS]; // 0..9
+    unsigned char dots;                 // bit n : decimal point on digit n
+    unsigned char blank;                // bit n : digit n hidden (edit blink)
+} Render_Model;
+
+typedef struct {
+    void (*draw)(const Render_Model *model);
+    unsigned char version;              // model version last drawn
+} Render_Backend;
+
+extern Render_Backend render_lcd;       // HD44780, first row
+extern Render_Backend render_segment;   // 4 digit multiplexed display
+
+/* Segment codes of the current model, refreshed by Render_Poll(&render_segment) */
+extern unsigned char render_segment_frame[RENDER_DIGITS];
+
+/* 7 segment data arrays, in program memory */
+extern const unsigned char segment[10];
+extern const unsigned char segment_with_dot[10];
+
+/*********** P R O T O T Y P E S **********************************************/
+void Render_Set(unsigned char mode, unsigned char d0, unsigned char d1, unsigned char d2,
+                unsigned char d3, unsigned char dots, unsigned char blank);
+void Render_Publish(const Render_Model *model);
+void Render_Poll(Render_Backend *backend);
+void Render_Invalidate(Render_Backend *backend);
+
+/* Fixed width fields, for LCD_Write_Field */
+unsigned char Render_Format_BCD(char *Buf, unsigned int Bcd, const char *Layout);
+void Render_Format_Uint(char *Buf, unsigned int Value, unsigned char Width);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* RENDER_H */
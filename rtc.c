@@ -0,0 +1,174 @@
+/*
+ * File:   rtc.c
+ *
+ * DS3231 / DS1307 real time clock on the LCD i2c bus.
+ */
+
+#include <xc.h>
+#include "rtc.h"
+#include "tick.h"
+
+static unsigned char rtc_present;
+static volatile unsigned int rtc_seconds;   // 1 Hz edges seen, wraps every 18 h
+static unsigned char rtc_sqw_last;
+static unsigned int rtc_ms;                 // software second when no RTC answers
+
+static unsigned char RTC_From_BCD(unsigned char bcd){
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static unsigned char RTC_To_BCD(unsigned char bin){
+    return (unsigned char)(((bin / 10) << 4) | (bin % 10));
+}
+
+/*******************************************************************************
+ * Function:        static unsigned char RTC_Write_Reg(unsigned char reg,
+ *                                                     unsigned char data)
+ * Description:     Writes one RTC register
+ * Return Values:   1 on ACK, 0 if the RTC did not answer
+ ******************************************************************************/
+static unsigned char RTC_Write_Reg(unsigned char reg, unsigned char data){
+    unsigned char nack;
+
+    I2C_Start(RTC_BUS);
+    nack = I2C_Send(RTC_BUS, RTC_ADDR);
+    nack |= I2C_Send(RTC_BUS, reg);
+    nack |= I2C_Send(RTC_BUS, data);
+    I2C_Stop(RTC_BUS);
+    return !nack;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char RTC_Init(void)
+ * Description:     Detects the RTC, starts its oscillator and the 1 Hz output
+ * Precondition:    I2C bus initialised
+ * Parameters:      None
+ * Return Values:   1 if the RTC answered
+ * Remarks:         Without an RTC, RTC_Seconds() falls back to the 1 ms tick
+ ******************************************************************************/
+unsigned char RTC_Init(void){
+    RTC_Time now;
+
+    RTC_SQW_ANSEL = 0;
+    RTC_SQW_TRIS = 1;
+    rtc_sqw_last = RTC_SQW;
+
+    rtc_present = I2C_Probe(RTC_BUS, RTC_ADDR);
+    if(!rtc_present)
+        return 0;
+
+#if RTC_MODEL == 1307
+    /* clock halt bit lives in the seconds register */
+    if(RTC_Read(&now) && (now.seconds & 0x80))
+        RTC_Write_Reg(RTC_REG_SECONDS, RTC_To_BCD(now.seconds & 0x7F));
+#else
+    (void)now;
+#endif
+    rtc_present = RTC_Write_Reg(RTC_REG_CONTROL, RTC_CONTROL_1HZ);
+    return rtc_present;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char RTC_Present(void)
+ * Description:     Tells whether RTC_Init found the clock
+ ******************************************************************************/
+unsigned char RTC_Present(void){
+    return rtc_present;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char RTC_Read(RTC_Time *time)
+ * Description:     Reads the seven time registers in one burst
+ * Precondition:    RTC_Init called
+ * Parameters:      time = destination, binary values
+ * Return Values:   1 on success, 0 if the RTC did not answer
+ * Remarks:         One I2C_Write_Read : register pointer, repeated START, 7 reads,
+ *                  ACK on all but the last. On the DS1307 bit 7 of seconds
+ *                  (clock halt) is kept so RTC_Init can see it.
+ ******************************************************************************/
+unsigned char RTC_Read(RTC_Time *time){
+    unsigned char reg = RTC_REG_SECONDS;
+    unsigned char buf[7];
+
+    if(!I2C_Write_Read(RTC_BUS, RTC_ADDR, &reg, 1, buf, sizeof(buf)))
+        return 0;
+
+    time->seconds = RTC_From_BCD(buf[0] & 0x7F) | (buf[0] & 0x80);
+    time->minutes = RTC_From_BCD(buf[1] & 0x7F);
+    time->hours = RTC_From_BCD(buf[2] & 0x3F);  // 24 hour mode
+    time->day = buf[3] & 0x07;
+    time->date = RTC_From_BCD(buf[4] & 0x3F);
+    time->month = RTC_From_BCD(buf[5] & 0x1F);
+    time->year = RTC_From_BCD(buf[6]);
+    return 1;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char RTC_Write(const RTC_Time *time)
+ * Description:     Sets the clock, seven registers in one burst
+ * Precondition:    RTC_Init called
+ * Parameters:      time = binary values, 24 hour mode
+ * Return Values:   1 on success, 0 if the RTC did not answer
+ ******************************************************************************/
+unsigned char RTC_Write(const RTC_Time *time){
+    unsigned char nack;
+
+    I2C_Start(RTC_BUS);
+    nack = I2C_Send(RTC_BUS, RTC_ADDR);
+    nack |= I2C_Send(RTC_BUS, RTC_REG_SECONDS);
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->seconds & 0x7F));
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->minutes));
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->hours));
+    nack |= I2C_Send(RTC_BUS, time->day);
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->date));
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->month));
+    nack |= I2C_Send(RTC_BUS, RTC_To_BCD(time->year));
+    I2C_Stop(RTC_BUS);
+    return !nack;
+}
+
+/*******************************************************************************
+ * Function:        unsigned int RTC_Seconds(void)
+ * Description:     Free running second counter
+ * Precondition:    RTC_Init called, RTC_Tick running
+ * Parameters:      None
+ * Return Values:   Seconds counted, modulo 65536
+ * Remarks:         Take differences, the absolute value has no meaning.
+ *                  Safe from the interrupt routine, the tick enable is
+ *                  restored rather than set.
+ ******************************************************************************/
+unsigned int RTC_Seconds(void){
+    unsigned char ie = TICK_IE;   /* kept, the HLVD interrupt calls this */
+    unsigned int now;
+
+    TICK_IE = 0;
+    now = rtc_seconds;
+    TICK_IE = ie;
+    return now;
+}
+
+/*******************************************************************************
+ * Function:        void RTC_Tick(unsigned char ms)
+ * Description:     Counts a second on each falling SQW edge
+ * Precondition:    Called from the interrupt routine on every tick
+ * Parameters:      ms = milliseconds since the last call
+ * Return Values:   None
+ * Remarks:         Without an RTC every 1000 ms of ticks count instead
+ ******************************************************************************/
+void RTC_Tick(unsigned char ms){
+    unsigned char sqw;
+
+    if(!rtc_present){
+        rtc_ms += ms;
+        if(rtc_ms >= 1000){
+            rtc_ms -= 1000;
+            rtc_seconds++;
+        }
+        return;
+    }
+
+    sqw = RTC_SQW;
+    if(rtc_sqw_last && !sqw)
+        rtc_seconds++;
+    rtc_sqw_last = sqw;
+}
@@ -0,0 +1,68 @@
+/*
+ * File:   rtc.h
+ *
+ * DS3231 / DS1307 real time clock on the LCD i2c bus.
+ * The 1 Hz square wave output (SQW) is the time base of the countdown.
+ */
+
+#ifndef RTC_H
+#define	RTC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+#include "i2c.h"
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+#ifndef RTC_MODEL
+#define RTC_MODEL   3231            // 3231 or 1307
+#endif
+
+#define RTC_BUS     (&I2C_BUS2)     // shares the LCD bus
+#define RTC_ADDR    (0x68 << 1)     // same address on both parts
+
+#define RTC_REG_SECONDS 0x00
+#if RTC_MODEL == 1307
+#define RTC_REG_CONTROL 0x07
+#define RTC_CONTROL_1HZ 0x10        // SQWE, RS1:RS0 = 00
+#else
+#define RTC_REG_CONTROL 0x0E
+#define RTC_CONTROL_1HZ 0x00        // oscillator on, INTCN = 0, RS2:RS1 = 00
+#endif
+
+/*********** P O R T   D E F I N E S ******************************************/
+/*
+ * Every external interrupt pin (RB0..RB2) and the interrupt-on-change pins
+ * (RB4..RB7) are taken by the segments and the LCD bus, so SQW goes to RC7
+ * and is sampled on the 1 ms tick. Needs a pull-up (fitted on RTC modules).
+ */
+#define RTC_SQW         PORTCbits.RC7
+#define RTC_SQW_TRIS    TRISCbits.TRISC7
+#define RTC_SQW_ANSEL   ANSELCbits.ANSC7
+
+/*********** T Y P E S ********************************************************/
+typedef struct {
+    unsigned char seconds;          // 0..59
+    unsigned char minutes;          // 0..59
+    unsigned char hours;            // 0..23
+    unsigned char day;              // 1..7
+    unsigned char date;             // 1..31
+    unsigned char month;            // 1..12
+    unsigned char year;             // 0..99
+} RTC_Time;
+
+/*********** P R O T O T Y P E S **********************************************/
+unsigned char RTC_Init(void);
+unsigned char RTC_Present(void);
+unsigned char RTC_Read(RTC_Time *time);
+unsigned char RTC_Write(const RTC_Time *time);
+unsigned int RTC_Seconds(void);
+void RTC_Tick(unsigned char ms);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* RTC_H */
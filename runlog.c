@@ -0,0 +1,167 @@
+/*
+ * File:   runlog.c
+ *
+ * History of countdown and stopwatch runs in a circular data EEPROM region.
+ */
+
+#include <xc.h>
+#include "runlog.h"
+#include "eeprom.h"
+
+static unsigned char log_head;          // next record to write
+static unsigned char log_count;         // valid records
+static unsigned char log_pass;          // pass bit of the record at log_head
+
+/* Runs appended but not written yet, already encoded except the pass bit */
+static unsigned char log_pending[LOG_PENDING][LOG_RECORD_SIZE];
+static unsigned char log_pending_count;
+
+/* One page of records read back in a burst */
+static unsigned char log_page[LOG_PAGE_RECORDS * LOG_RECORD_SIZE];
+static unsigned char log_page_no = 0xFF; // cached page, 0xFF = none
+
+/*******************************************************************************
+ * Function:        void Log_Init(void)
+ * Description:     Finds the write position with one scan of the first bytes
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         LOG_RECORDS EEPROM reads
+ ******************************************************************************/
+void Log_Init(void){
+    unsigned char i, b0, pass0;
+
+    pass0 = (unsigned char)EEPROM_Read(EE_LOG_BASE) >> 7;
+    for(i = 0; i < LOG_RECORDS; i++){
+        b0 = EEPROM_Read(EE_LOG_BASE + i * LOG_RECORD_SIZE);
+        if(((b0 >> 5) & 0x03) == LOG_EMPTY){
+            // region never filled : records 0 .. i-1 are all there is
+            log_head = i;
+            log_count = i;
+            log_pass = i ? pass0 : 0;
+            return;
+        }
+        if((b0 >> 7) != pass0){
+            // the previous pass continues from here
+            log_head = i;
+            log_count = LOG_RECORDS;
+            log_pass = pass0;
+            return;
+        }
+    }
+    // every record is from the same pass, the next one starts a new pass
+    log_head = 0;
+    log_count = LOG_RECORDS;
+    log_pass = pass0 ^ 1;
+}
+
+/*******************************************************************************
+ * Function:        void Log_Append(unsigned char reason, unsigned int duration,
+ *                                  unsigned long elapsed)
+ * Description:     Queues a run for the log
+ * Precondition:    Log_Init called
+ * Parameters:      reason = LOG_EXPIRED, LOG_ABORTED or LOG_STOPWATCH
+ *                  duration = minutes set, elapsed = seconds run
+ * Return Values:   None
+ * Remarks:         RAM only, the EEPROM is written later by Log_Service.
+ *                  When the queue is full the run is dropped.
+ ******************************************************************************/
+void Log_Append(unsigned char reason, unsigned int duration, unsigned long elapsed){
+    unsigned char *rec;
+    unsigned int span;
+
+    if(log_pending_count >= LOG_PENDING)
+        return;
+    rec = log_pending[log_pending_count++];
+
+    if(duration > 0x1FFF)
+        duration = 0x1FFF;
+    if(elapsed < 0x8000)
+        span = (unsigned int)elapsed;
+    else if(elapsed / 60 < 0x8000)
+        span = 0x8000 | (unsigned int)(elapsed / 60);
+    else
+        span = 0xFFFF;
+
+    rec[0] = (unsigned char)((reason & 0x03) << 5) | (unsigned char)(duration >> 8);
+    rec[1] = (unsigned char)duration;
+    rec[2] = (unsigned char)(span >> 8);
+    rec[3] = (unsigned char)span;
+}
+
+/*******************************************************************************
+ * Function:        void Log_Service(void)
+ * Description:     Writes every queued run in one go
+ * Precondition:    Called from the idle loop
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         Nothing to do costs one compare
+ ******************************************************************************/
+void Log_Service(void){
+    unsigned char i, addr;
+    unsigned char *rec;
+
+    for(i = 0; i < log_pending_count; i++){
+        rec = log_pending[i];
+        addr = EE_LOG_BASE + log_head * LOG_RECORD_SIZE;
+
+        EEPROM_Update(addr + 3, rec[3]);
+        EEPROM_Update(addr + 2, rec[2]);
+        EEPROM_Update(addr + 1, rec[1]);
+        EEPROM_Update(addr, rec[0] | (unsigned char)(log_pass << 7)); // commits the record
+
+        if(log_head / LOG_PAGE_RECORDS == log_page_no)
+            log_page_no = 0xFF;
+        if(++log_head == LOG_RECORDS){
+            log_head = 0;
+            log_pass ^= 1;
+        }
+        if(log_count < LOG_RECORDS)
+            log_count++;
+    }
+    log_pending_count = 0;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Log_Count(void)
+ * Description:     Number of runs in the log, written ones only
+ ******************************************************************************/
+unsigned char Log_Count(void){
+    return log_count;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Log_Get(unsigned char n, Log_Entry *entry)
+ * Description:     Reads one run
+ * Precondition:    Log_Init called
+ * Parameters:      n = 0 for the newest run, entry = decoded record
+ * Return Values:   1 if the run exists
+ * Remarks:         Records are read a page at a time into RAM, so stepping
+ *                  through the history touches the EEPROM once per page
+ ******************************************************************************/
+unsigned char Log_Get(unsigned char n, Log_Entry *entry){
+    unsigned char slot, page, i;
+    unsigned char *rec;
+    unsigned int span;
+
+    if(n >= log_count)
+        return 0;
+
+    slot = (unsigned char)(log_head + LOG_RECORDS - 1 - n) % LOG_RECORDS;
+    page = slot / LOG_PAGE_RECORDS;
+    if(page != log_page_no){
+        for(i = 0; i < sizeof(log_page); i++)
+            log_page[i] = EEPROM_Read(EE_LOG_BASE + page * sizeof(log_page) + i);
+        log_page_no = page;
+    }
+    rec = &log_page[(slot % LOG_PAGE_RECORDS) * LOG_RECORD_SIZE];
+
+    entry->reason = (rec[0] >> 5) & 0x03;
+    entry->duration = ((unsigned int)(rec[0] & 0x1F) << 8) | rec[1];
+    span = ((unsigned int)rec[2] << 8) | rec[3];
+    if(span & 0x8000)
+        entry->elapsed = (unsigned long)(span & 0x7FFF) * 60;
+    else
+        entry->elapsed = span;
+    return 1;
+}
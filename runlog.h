@@ -0,0 +1,56 @@
+/*
+ * File:   runlog.h
+ *
+ * History of countdown and stopwatch runs in a circular data EEPROM region.
+ */
+
+#ifndef RUNLOG_H
+#define	RUNLOG_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+#define LOG_RECORD_SIZE     4
+#define LOG_RECORDS         32          // EE_LOG_BASE .. 0xFF
+#define LOG_PAGE_RECORDS    4           // records per RAM cache page
+#define LOG_PENDING         4           // runs waiting to be written
+
+/* End reasons */
+#define LOG_EXPIRED         0           // countdown reached 00:00
+#define LOG_ABORTED         1           // countdown stopped with button 3
+#define LOG_STOPWATCH       2           // count-up run
+#define LOG_EMPTY           3           // erased cell, never written
+
+/*
+ * Record, 4 bytes :
+ *   byte 0   bit 7 pass, bits 6..5 reason, bits 4..0 duration minutes 12..8
+ *   byte 1   duration minutes 7..0
+ *   byte 2-3 elapsed, big endian : bit 15 clear -> seconds (0..32767),
+ *            bit 15 set -> minutes
+ * The pass bit flips each time the region wraps, so the write position is
+ * the first record whose pass differs from record 0, or that is empty.
+ * Byte 0 is written last : a torn record still looks like the old pass and
+ * is simply overwritten by the next run.
+ */
+typedef struct {
+    unsigned char reason;
+    unsigned int duration;              // minutes set for the run
+    unsigned long elapsed;              // seconds actually run
+} Log_Entry;
+
+/*********** P R O T O T Y P E S **********************************************/
+void Log_Init(void);
+void Log_Append(unsigned char reason, unsigned int duration, unsigned long elapsed);
+void Log_Service(void);
+unsigned char Log_Count(void);
+unsigned char Log_Get(unsigned char n, Log_Entry *entry);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* RUNLOG_H */
@@ -0,0 +1,190 @@
+/*
+ * File:   segmux.c
+ *
+ * Interrupt driven scan of the 4 digit 7 segment display on Timer2.
+ * The patterns come from the render layer (render_segment_frame).
+ */
+
+#include <xc.h>
+#include "segmux.h"
+#include "render.h"
+
+/* Lit counts per digit for each brightness level, the rest of the slot is dark */
+static const unsigned char segmux_on_counts[SEGMUX_LEVELS] = {8, 24, 64, 140, SEGMUX_SLOT - SEGMUX_BLANK_MIN};
+
+static unsigned char segmux_level = SEGMUX_LEVEL_BRIGHT;   // level while awake
+static volatile unsigned char segmux_pr_on;                // PR2 for the lit part
+static volatile unsigned char segmux_pr_off;               // PR2 for the dark gap
+static volatile unsigned int segmux_idle_frames;           // frames left before dimming
+static unsigned char segmux_digit;                         // digit lit or next, 0..3
+static unsigned char segmux_lit;
+static unsigned char segmux_enabled;
+
+/*******************************************************************************
+ * Function:        static void SegMux_Level(unsigned char level)
+ * Description:     Loads the lit and dark times of a brightness level
+ ******************************************************************************/
+static void SegMux_Level(unsigned char level){
+    segmux_pr_on = segmux_on_counts[level] - 1;
+    segmux_pr_off = SEGMUX_SLOT - segmux_on_counts[level] - 1;
+}
+
+/*******************************************************************************
+ * Function:        void SegMux_Init(void)
+ * Description:     Digit and segment pins as outputs, all dark, scan stopped
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         Timer2 clocking is set by Clock_Set, only TMR2ON is ours
+ ******************************************************************************/
+void SegMux_Init(void){
+    LATA &= (unsigned char)~SEGMUX_DIGIT_MASK;
+    ANSELA &= (unsigned char)~SEGMUX_DIGIT_MASK;
+    TRISA &= (unsigned char)~SEGMUX_DIGIT_MASK;
+
+    ANSELB &= SEGMUX_I2C_MASK;
+    TRISB &= SEGMUX_I2C_MASK;
+#if SEGMENT_BC_PORTC
+    ANSELC &= (unsigned char)~SEGMUX_BC_TRISC;
+    TRISC &= (unsigned char)~SEGMUX_BC_TRISC;
+#endif
+
+    SegMux_Level(segmux_level);
+    segmux_idle_frames = SEGMUX_DIM_MS / SEGMUX_FRAME_MS;
+    segmux_enabled = 0;
+}
+
+/*******************************************************************************
+ * Function:        void SegMux_Enable(unsigned char on)
+ * Description:     Starts or stops the scan
+ * Precondition:    SegMux_Init called
+ * Parameters:      on = 1 to scan render_segment_frame, 0 for a dark display
+ * Return Values:   None
+ * Remarks:         Starting does not wake a dimmed display, see SegMux_Wake
+ ******************************************************************************/
+void SegMux_Enable(unsigned char on){
+    if(on == segmux_enabled)
+        return;
+    segmux_enabled = on;
+
+    PIE1bits.TMR2IE = 0;
+    T2CONbits.TMR2ON = 0;
+    LATA &= (unsigned char)~SEGMUX_DIGIT_MASK;
+#if !SEGMENT_BC_PORTC
+    I2C_Pins_Release(&I2C_BUS2);
+#endif
+    if(!on)
+        return;
+
+    segmux_lit = 0;                     // first event lights digit 1
+    segmux_digit = RENDER_DIGITS - 1;
+    TMR2 = 0;
+    PR2 = segmux_pr_off;
+    SEGMUX_FLAG = 0;
+    PIE1bits.TMR2IE = 1;
+    T2CONbits.TMR2ON = 1;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char SegMux_Enabled(void)
+ * Description:     Tells whether the scan is running
+ ******************************************************************************/
+unsigned char SegMux_Enabled(void){
+    return segmux_enabled;
+}
+
+/*******************************************************************************
+ * Function:        void SegMux_Brightness(unsigned char level)
+ * Description:     Sets the level used while the display is awake
+ * Precondition:    None
+ * Parameters:      level = 0 .. SEGMUX_LEVELS - 1
+ * Return Values:   None
+ * Remarks:         Also wakes the display
+ ******************************************************************************/
+void SegMux_Brightness(unsigned char level){
+    if(level >= SEGMUX_LEVELS)
+        level = SEGMUX_LEVELS - 1;
+    segmux_level = level;
+    SegMux_Wake();
+}
+
+/*******************************************************************************
+ * Function:        void SegMux_Wake(void)
+ * Description:     Back to full level, dims again after SEGMUX_DIM_MS
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         Call on user activity and while something runs
+ ******************************************************************************/
+void SegMux_Wake(void){
+    unsigned char ie = PIE1bits.TMR2IE;
+
+    PIE1bits.TMR2IE = 0;
+    SegMux_Level(segmux_level);
+    segmux_idle_frames = SEGMUX_DIM_MS / SEGMUX_FRAME_MS;
+    PIE1bits.TMR2IE = ie;
+}
+
+/*******************************************************************************
+ * Function:        static void SegMux_Phase(void)
+ * Description:     Ends the current phase : a lit time or a dark gap
+ * Remarks:         Loads PR2 with the length of the phase that starts
+ ******************************************************************************/
+static void SegMux_Phase(void){
+    unsigned char pattern;
+
+    if(segmux_lit){
+        LATA &= (unsigned char)~SEGMUX_DIGIT_MASK;  // dark gap, every digit off
+#if !SEGMENT_BC_PORTC
+        I2C_Pins_Release(&I2C_BUS2);                // a waiting I2C_Start may have b/c now
+#endif
+        PR2 = segmux_pr_off;
+        segmux_lit = 0;
+        return;
+    }
+
+    segmux_digit = (segmux_digit + 1) & (RENDER_DIGITS - 1);
+    if(segmux_digit == 0 && segmux_idle_frames && --segmux_idle_frames == 0)
+        SegMux_Level(SEGMUX_LEVEL_DIM);
+
+    PR2 = segmux_pr_on;
+    segmux_lit = 1;
+#if !SEGMENT_BC_PORTC
+    if(!I2C_Pins_Take(&I2C_BUS2))
+        return;                         // b/c are on the bus : this digit stays dark, PORTB untouched
+#endif
+
+    // segments change while all digits are dark, then the digit is lit
+    pattern = render_segment_frame[segmux_digit];
+    LATB = (LATB & SEGMUX_I2C_MASK) | (pattern & (unsigned char)~SEGMUX_I2C_MASK);
+#if SEGMENT_BC_PORTC
+    SEGMUX_B_LAT = (pattern >> 1) & 1;
+    SEGMUX_C_LAT = (pattern >> 2) & 1;
+#else
+    I2C_Pins_Write(&I2C_BUS2, (pattern >> 1) & 1, (pattern >> 2) & 1);
+#endif
+    LATA |= (unsigned char)(1 << segmux_digit);
+}
+
+/*******************************************************************************
+ * Function:        void SegMux_ISR(void)
+ * Description:     One scan event : end of a lit time or end of a dark gap
+ * Precondition:    Called from the interrupt routine when SEGMUX_FLAG is set
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         Timer2 restarts from 0 on the match, so the new PR2 is
+ *                  the length of the next phase. When the interrupt was
+ *                  held off longer than that phase (a 12 count dark gap
+ *                  behind the tick handlers), TMR2 is already past PR2 and
+ *                  would run on to 255 : the phase has had its time, so
+ *                  the next one is taken now and Timer2 restarted for it.
+ ******************************************************************************/
+void SegMux_ISR(void){
+    SEGMUX_FLAG = 0;
+
+    SegMux_Phase();
+    if(TMR2 > PR2){
+        SegMux_Phase();
+        TMR2 = 0;                       // also clears the postscaler, a full phase follows
+    }
+}
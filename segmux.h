@@ -0,0 +1,75 @@
+/*
+ * File:   segmux.h
+ *
+ * Interrupt driven scan of the 4 digit 7 segment display on Timer2,
+ * with brightness levels and an idle dim.
+ */
+
+#ifndef SEGMUX_H
+#define	SEGMUX_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+#include "i2c.h"
+
+/*********** P O R T   D E F I N E S ******************************************/
+#define SEGMUX_DIGIT_MASK   0x0F        // RA0..RA3 select digit 1..4, high = lit
+#define SEGMUX_I2C_MASK     0x06        // RB1/RB2 are SCK2/SDA2, never written as a port
+
+/*
+ * Segments b and c : on the original board they are RB1/RB2 and are driven
+ * through I2C_Pins_Take/I2C_Pins_Write between transactions; a digit whose
+ * turn comes while a transaction runs stays dark for that slot. Boards
+ * reworked for SEGMENT_BC_PORTC (i2c.h) have them on RC4/RC5.
+ */
+#if SEGMENT_BC_PORTC
+#define SEGMUX_B_LAT        LATCbits.LATC4
+#define SEGMUX_C_LAT        LATCbits.LATC5
+#define SEGMUX_BC_TRISC     0x30
+#endif
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+/*
+ * Timer2 counts at 250 kHz at every clock speed (4 us per count, see
+ * clock.c). Each digit owns SEGMUX_SLOT counts : lit for the on time of the
+ * brightness level, then all digits dark for the rest. The segment lines only
+ * change inside that dark gap, which is what keeps the next digit's pattern
+ * from ghosting on the previous one.
+ */
+#define SEGMUX_SLOT         250         // 1 ms per digit, 250 Hz frame
+#define SEGMUX_BLANK_MIN    12          // shortest dark gap, 48 us
+#define SEGMUX_FLAG         PIR1bits.TMR2IF
+
+/* Brightness : 0 (dimmest) .. SEGMUX_LEVELS - 1 */
+#define SEGMUX_LEVELS       5
+#ifndef SEGMUX_LEVEL_BRIGHT
+#define SEGMUX_LEVEL_BRIGHT 4           // after SegMux_Wake
+#endif
+#ifndef SEGMUX_LEVEL_DIM
+#define SEGMUX_LEVEL_DIM    1           // after SEGMUX_DIM_MS without a wake
+#endif
+#define SEGMUX_DIM_MS       10000
+#define SEGMUX_FRAME_MS     4           // SEGMUX_SLOT x 4 us x 4 digits
+
+/*
+ * One scan event costs about 100 instructions with the b/c pin handover.
+ * At 1 MHz that is most of the CPU, so the clock must stay at CLOCK_RUN or
+ * above while the scan runs.
+ */
+
+/*********** P R O T O T Y P E S **********************************************/
+void SegMux_Init(void);
+void SegMux_Enable(unsigned char on);
+unsigned char SegMux_Enabled(void);
+void SegMux_Brightness(unsigned char level);
+void SegMux_Wake(void);
+void SegMux_ISR(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SEGMUX_H */
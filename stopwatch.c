@@ -0,0 +1,162 @@
+/*
+ * File:   stopwatch.c
+ *
+ * Count-up stopwatch with lap capture.
+ */
+
+#include <xc.h>
+#include "stopwatch.h"
+#include "eeprom.h"
+#include "tick.h"
+
+static volatile unsigned long sw_ms;            // elapsed time of the run
+static volatile unsigned char sw_running;
+static unsigned long sw_laps[SW_LAPS];          // ring of split times
+static volatile unsigned int sw_lap_total;      // laps taken, next ring slot is total % SW_LAPS
+static unsigned char sw_button;                 // debounced lap button, 1 = pressed
+static unsigned char sw_debounce;
+
+/*******************************************************************************
+ * Function:        void Stopwatch_Start(void)
+ * Description:     Clears the laps and starts counting from zero
+ * Precondition:    Tick_Init called
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         A button 3 already held down does not count as a lap
+ ******************************************************************************/
+void Stopwatch_Start(void){
+    TICK_IE = 0;
+    sw_ms = 0;
+    sw_lap_total = 0;
+    sw_button = !SW_LAP_BUTTON;
+    sw_debounce = SW_DEBOUNCE_MS;
+    sw_running = 1;
+    TICK_IE = 1;
+}
+
+/*******************************************************************************
+ * Function:        void Stopwatch_Stop(void)
+ * Description:     Freezes the elapsed time and the laps
+ ******************************************************************************/
+void Stopwatch_Stop(void){
+    sw_running = 0;
+}
+
+/*******************************************************************************
+ * Function:        unsigned long Stopwatch_Elapsed(void)
+ * Description:     Reads the elapsed time
+ * Precondition:    None
+ * Parameters:      None
+ * Return Values:   Milliseconds since Stopwatch_Start
+ * Remarks:         Four byte read, so the tick interrupt is held off
+ ******************************************************************************/
+unsigned long Stopwatch_Elapsed(void){
+    unsigned long ms;
+
+    TICK_IE = 0;
+    ms = sw_ms;
+    TICK_IE = 1;
+    return ms;
+}
+
+/*******************************************************************************
+ * Function:        unsigned int Stopwatch_Lap_Total(void)
+ * Description:     Number of laps taken in this run, held or not
+ ******************************************************************************/
+unsigned int Stopwatch_Lap_Total(void){
+    unsigned int total;
+
+    TICK_IE = 0;
+    total = sw_lap_total;
+    TICK_IE = 1;
+    return total;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Stopwatch_Lap_Count(void)
+ * Description:     Number of laps held in the ring, at most SW_LAPS
+ ******************************************************************************/
+unsigned char Stopwatch_Lap_Count(void){
+    unsigned int total = Stopwatch_Lap_Total();
+
+    return total < SW_LAPS ? (unsigned char)total : SW_LAPS;
+}
+
+/*******************************************************************************
+ * Function:        unsigned long Stopwatch_Lap_Get(unsigned char index)
+ * Description:     Reads one held lap
+ * Precondition:    index < Stopwatch_Lap_Count()
+ * Parameters:      index = 0 for the oldest held lap
+ * Return Values:   Split time of the lap in milliseconds
+ * Remarks:         The held laps are numbered
+ *                  Stopwatch_Lap_Total() - Stopwatch_Lap_Count() + index + 1
+ ******************************************************************************/
+unsigned long Stopwatch_Lap_Get(unsigned char index){
+    unsigned char count = Stopwatch_Lap_Count();
+    unsigned long ms;
+
+    TICK_IE = 0;
+    index = (unsigned char)(sw_lap_total - count + index) & (SW_LAPS - 1);
+    ms = sw_laps[index];
+    TICK_IE = 1;
+    return ms;
+}
+
+/*******************************************************************************
+ * Function:        void Stopwatch_Flush(void)
+ * Description:     Stores the held laps in data EEPROM, oldest first
+ * Precondition:    Stopwatch_Stop called
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         The lap count is cleared first and written last, so a
+ *                  reset half way leaves an empty record rather than a torn
+ *                  one. Unchanged cells are not rewritten.
+ ******************************************************************************/
+void Stopwatch_Flush(void){
+    unsigned char count = Stopwatch_Lap_Count();
+    unsigned int total = Stopwatch_Lap_Total();
+    unsigned char i, b, addr = EE_LAP_BASE;
+    unsigned long ms;
+
+    EEPROM_Update(EE_LAP_COUNT, 0);
+    EEPROM_Update(EE_LAP_TOTAL, total > 255 ? 255 : (unsigned char)total);
+    for(i = 0; i < count; i++){
+        ms = Stopwatch_Lap_Get(i);
+        for(b = 0; b < 4; b++){
+            EEPROM_Update(addr++, (unsigned char)ms);
+            ms >>= 8;
+        }
+    }
+    EEPROM_Update(EE_LAP_COUNT, count);
+}
+
+/*******************************************************************************
+ * Function:        void Stopwatch_Tick(unsigned char ms)
+ * Description:     Counts the elapsed time and samples the lap button
+ * Precondition:    Called from the interrupt routine once per tick
+ * Parameters:      ms = milliseconds since the last call
+ * Return Values:   None
+ * Remarks:         A lap is the press edge of button 3, debounced by
+ *                  ignoring the pin for SW_DEBOUNCE_MS after every edge
+ ******************************************************************************/
+void Stopwatch_Tick(unsigned char ms){
+    unsigned char pressed;
+
+    if(!sw_running)
+        return;
+    sw_ms += ms;
+
+    if(sw_debounce){
+        sw_debounce = sw_debounce > ms ? sw_debounce - ms : 0;
+        return;
+    }
+    pressed = !SW_LAP_BUTTON;
+    if(pressed == sw_button)
+        return;
+    sw_button = pressed;
+    sw_debounce = SW_DEBOUNCE_MS;
+    if(pressed){
+        sw_laps[(unsigned char)sw_lap_total & (SW_LAPS - 1)] = sw_ms;
+        sw_lap_total++;
+    }
+}
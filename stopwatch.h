@@ -0,0 +1,43 @@
+/*
+ * File:   stopwatch.h
+ *
+ * Count-up stopwatch with lap capture, run from the 1 ms tick.
+ */
+
+#ifndef STOPWATCH_H
+#define	STOPWATCH_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+#define SW_LAPS             8           // laps kept in RAM, power of two
+#define SW_DEBOUNCE_MS      30          // lap button ignored after an edge
+#define SW_LAP_BUTTON       PORTCbits.RC2   // button 3, active low
+
+/*
+ * Laps are taken in the tick interrupt : a press of button 3 copies the
+ * running time into the RAM ring and nothing else, so laps a few tens of
+ * milliseconds apart are all kept whatever the main loop is doing. Only the
+ * newest SW_LAPS laps are held; they reach EEPROM in one batch from
+ * Stopwatch_Flush once the run has stopped.
+ */
+
+/*********** P R O T O T Y P E S **********************************************/
+void Stopwatch_Start(void);
+void Stopwatch_Stop(void);
+unsigned long Stopwatch_Elapsed(void);
+unsigned int Stopwatch_Lap_Total(void);
+unsigned char Stopwatch_Lap_Count(void);
+unsigned long Stopwatch_Lap_Get(unsigned char index);
+void Stopwatch_Flush(void);
+void Stopwatch_Tick(unsigned char ms);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* STOPWATCH_H */
@@ -0,0 +1,108 @@
+/*
+ * File:   tick.c
+ *
+ * 1 ms system tick on Timer4.
+ */
+
+#include <xc.h>
+#include "tick.h"
+
+static volatile unsigned int tick_ms;   // wraps every 65.5 s
+static volatile unsigned char tick_quarters;    // quarter ms counted, not yet handed out
+static unsigned char tick_us_per_count = 1;     // also quarter ms per Timer4 period
+
+/*******************************************************************************
+ * Function:        void Tick_Init(void)
+ * Description:     Sets the Timer4 period and enables its interrupt
+ * Precondition:    Clock_Set called, it starts Timer4 with the prescalers
+ * Parameters:      None
+ * Return Values:   None
+ * Remarks:         PEIE and GIE are enabled by main()
+ ******************************************************************************/
+void Tick_Init(void){
+    PR4 = TICK_PERIOD - 1;
+    TMR4 = 0;
+    TICK_FLAG = 0;
+    TICK_IE = 1;
+}
+
+/*******************************************************************************
+ * Function:        void Tick_Rate(unsigned char t4con, unsigned char us_per_count)
+ * Description:     Rescales Timer4 after a CPU clock change
+ * Precondition:    Called by Clock_Set once the new clock runs
+ * Parameters:      t4con = prescaler and TMR4ON for the new clock
+ *                  us_per_count = 1, 4 or 16 at that prescaler
+ * Return Values:   None
+ * Remarks:         The part of the period already counted is converted to
+ *                  the new count rate instead of being dropped, so a clock
+ *                  change costs at most one new count. The oscillator
+ *                  switch itself (the PLL lock on the way to 64 MHz) is
+ *                  counted at the old rate.
+ ******************************************************************************/
+void Tick_Rate(unsigned char t4con, unsigned char us_per_count){
+    unsigned char ie = TICK_IE;
+    unsigned int us;
+
+    TICK_IE = 0;
+    T4CONbits.TMR4ON = 0;
+    if(TICK_FLAG){                      // a period ended while masked, at the old rate
+        TICK_FLAG = 0;
+        tick_quarters += tick_us_per_count;
+    }
+    us = (unsigned int)TMR4 * tick_us_per_count;
+    tick_quarters += (unsigned char)(us / 250);
+    TMR4 = (unsigned char)((us % 250) / us_per_count);
+    tick_us_per_count = us_per_count;
+    T4CON = t4con;                      // also clears the prescaler
+    TICK_IE = ie;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Tick_ISR(void)
+ * Description:     Counts the Timer4 period that just ended
+ * Precondition:    Called from the interrupt routine when TICK_FLAG is set
+ * Parameters:      None
+ * Return Values:   Whole milliseconds to hand to the tick handlers, 0 when
+ *                  the period did not complete one (64 MHz)
+ * Remarks:         Timer4 restarts itself on the PR4 match, so interrupt
+ *                  latency delays the count but never drifts it
+ ******************************************************************************/
+unsigned char Tick_ISR(void){
+    unsigned char ms;
+
+    TICK_FLAG = 0;
+    tick_quarters += tick_us_per_count;
+    ms = tick_quarters >> 2;
+    tick_quarters &= 3;
+    tick_ms += ms;
+    return ms;
+}
+
+/*******************************************************************************
+ * Function:        unsigned int Tick_Get(void)
+ * Description:     Reads the millisecond counter
+ * Precondition:    Tick_Init called
+ * Parameters:      None
+ * Return Values:   Milliseconds since Tick_Init, modulo 65536
+ * Remarks:         Two byte read, so the tick interrupt is held off
+ ******************************************************************************/
+unsigned int Tick_Get(void){
+    unsigned int now;
+
+    TICK_IE = 0;
+    now = tick_ms;
+    TICK_IE = 1;
+    return now;
+}
+
+/*******************************************************************************
+ * Function:        unsigned char Tick_Expired(unsigned int deadline)
+ * Description:     Checks a deadline taken from Tick_Get() + delay
+ * Precondition:    Tick_Init called, delay below 32768 ms
+ * Parameters:      deadline = tick value to wait for
+ * Return Values:   1 once the deadline has passed
+ * Remarks:         Wrap safe
+ ******************************************************************************/
+unsigned char Tick_Expired(unsigned int deadline){
+    return (int)(Tick_Get() - deadline) >= 0;
+}
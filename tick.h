@@ -0,0 +1,46 @@
+/*
+ * File:   tick.h
+ *
+ * 1 ms system tick on Timer4, the time base for the background drivers.
+ */
+
+#ifndef TICK_H
+#define	TICK_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#include <xc.h>
+
+/*********** G E N E R A L   D E F I N E S ************************************/
+/*
+ * Timer4 matches PR4 every 250 counts, so the period is set by hardware :
+ * nothing is reloaded in the interrupt and latency cannot stretch it.
+ * Timer4 is a peripheral interrupt, PEIE must be set.
+ *
+ * The count rate follows the CPU clock (Clock_Set calls Tick_Rate) :
+ *   64 MHz   1 us per count   250 us period   4 interrupts per ms
+ *   16 MHz   4 us per count     1 ms period
+ *    1 MHz  16 us per count     4 ms period   tick handlers see 4 ms at once
+ * The longer period at 1 MHz leaves 1000 instruction cycles per interrupt
+ * instead of 250, so the handlers cannot crowd out the main loop.
+ * The microseconds per count equal the quarter milliseconds per period,
+ * which is what the interrupt adds up.
+ */
+#define TICK_PERIOD     250             // Timer4 counts per period
+#define TICK_FLAG       PIR5bits.TMR4IF
+#define TICK_IE         PIE5bits.TMR4IE // masked around multi-byte reads of tick driven state
+
+/*********** P R O T O T Y P E S **********************************************/
+void Tick_Init(void);
+void Tick_Rate(unsigned char t4con, unsigned char us_per_count);
+unsigned char Tick_ISR(void);
+unsigned int Tick_Get(void);
+unsigned char Tick_Expired(unsigned int deadline);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* TICK_H */
@@ -0,0 +1,282 @@
+/*
+ * File:   lcd_trace_decode.c
+ *
+ * Host side decoder for the I2C_TRACE dump of the timer firmware.
+ *
+ * Replays the PCF8574 byte stream through a 4-bit HD44780 model, prints the
+ * screen every time a burst of writes has changed it, and flags traffic that
+ * had no visible effect (redundant cursor sets, rewrites of an unchanged
+ * character, expander writes that do not move E).
+ *
+ * Build : cc -O2 -Wall -o lcd_trace_decode lcd_trace_decode.c
+ * Usage : lcd_trace_decode [-a addr] [-c cols] [-r rows] [-t ns] < dump.txt
+ *           -a  8-bit write address of the LCD backpack (default: first seen)
+ *           -c  columns (16)   -r  rows (2)   -t  ns per time stamp (500)
+ *
+ * Input lines are "T aa dd ff tttt" in hex, as printed by I2C_Trace_Dump.
+ * Anything else is ignored, so a raw serial capture can be piped in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_NACK  0x01
+#define TRACE_ADDR  0x02
+
+/* PCF8574 backpack wiring */
+#define PIN_RS      0x01
+#define PIN_RW      0x02
+#define PIN_EN      0x04
+
+static const unsigned char row_base[4] = {0x00, 0x40, 0x14, 0x54};
+
+/* HD44780 model */
+static unsigned char ddram[128];
+static unsigned char ac;            /* address counter */
+static int shift;                   /* display shift */
+static int increment = 1;           /* entry mode I/D */
+static int four_bit = 1;            /* DL = 0, dumps usually start mid-stream */
+static int in_cgram;                /* data writes go to CGRAM */
+static int phase;                   /* 4-bit mode: high nibble latched */
+static unsigned char high_nibble;
+static int high_rs;
+
+static int cols = 16, rows = 2;
+static unsigned long ns_per_tick = 500;
+
+/* Statistics */
+static unsigned long n_bytes, n_cmds, n_data, n_redundant_set, n_same_char, n_idle_writes;
+static unsigned long n_nack;
+static unsigned long long now_ticks;
+
+static char shown[4][41];
+static int dirty;
+
+static unsigned char ddram_index(int row, int col)
+{
+    int line = row & 1;
+    int off = (row_base[row] & 0x3F) + col + shift;
+
+    off %= 40;
+    if (off < 0)
+        off += 40;
+    return (unsigned char)(line * 0x40 + off);
+}
+
+static void print_screen(void)
+{
+    int r, c;
+    char line[41];
+    int changed = 0;
+
+    for (r = 0; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            unsigned char ch = ddram[ddram_index(r, c)];
+            if (ch < 0x08)
+                line[c] = '#';      /* custom character (progress bar) */
+            else
+                line[c] = (ch >= 0x20 && ch < 0x7F) ? (char)ch : '?';
+        }
+        line[cols] = '\0';
+        if (strcmp(line, shown[r]) != 0)
+            changed = 1;
+        strcpy(shown[r], line);
+    }
+    dirty = 0;
+    if (!changed)
+        return;
+
+    printf("@%10.3f ms\n", now_ticks * ns_per_tick / 1e6);
+    printf("  +");
+    for (c = 0; c < cols; c++)
+        putchar('-');
+    printf("+\n");
+    for (r = 0; r < rows; r++)
+        printf("  |%s|\n", shown[r]);
+    printf("  +");
+    for (c = 0; c < cols; c++)
+        putchar('-');
+    printf("+\n");
+}
+
+static void warn(const char *what, unsigned char v)
+{
+    printf("@%10.3f ms  waste: %s (0x%02x)\n", now_ticks * ns_per_tick / 1e6, what, v);
+}
+
+static unsigned char ac_next(unsigned char a)
+{
+    /* two 40 character lines : 0x00-0x27 and 0x40-0x67 */
+    if (increment) {
+        if (a == 0x27)
+            return 0x40;
+        if (a == 0x67)
+            return 0x00;
+        return a + 1;
+    }
+    if (a == 0x00)
+        return 0x67;
+    if (a == 0x40)
+        return 0x27;
+    return a - 1;
+}
+
+static void instruction(unsigned char cmd)
+{
+    n_cmds++;
+    if (dirty)
+        print_screen();
+
+    if (cmd & 0x80) {
+        unsigned char target = cmd & 0x7F;
+
+        if (target == ac && !in_cgram)
+            n_redundant_set++, warn("cursor already there", cmd);
+        ac = target;
+        in_cgram = 0;
+    } else if (cmd & 0x40) {
+        /* CGRAM address, glyph data is not modelled */
+        in_cgram = 1;
+    } else if (cmd & 0x20) {
+        four_bit = !(cmd & 0x10);
+    } else if (cmd & 0x10) {
+        if (cmd & 0x08)
+            shift += (cmd & 0x04) ? 1 : -1;
+        else
+            ac = (cmd & 0x04) ? ac_next(ac) : ac;
+    } else if (cmd & 0x08) {
+        /* display on/off control */
+    } else if (cmd & 0x04) {
+        increment = (cmd & 0x02) != 0;
+    } else if (cmd & 0x02) {
+        ac = 0;
+        shift = 0;
+        in_cgram = 0;
+    } else if (cmd & 0x01) {
+        memset(ddram, ' ', sizeof(ddram));
+        in_cgram = 0;
+        ac = 0;
+        shift = 0;
+        increment = 1;
+        dirty = 1;
+    }
+}
+
+static void data_write(unsigned char ch)
+{
+    n_data++;
+    if (in_cgram)
+        return;
+    if (ddram[ac & 0x7F] == ch)
+        n_same_char++, warn("character unchanged", ch);
+    else
+        dirty = 1;
+    ddram[ac & 0x7F] = ch;
+    ac = ac_next(ac);
+}
+
+/* One falling edge of E with the expander output byte that was latched */
+static void strobe(unsigned char out)
+{
+    unsigned char nibble = out & 0xF0;
+    int rs = out & PIN_RS;
+
+    if (out & PIN_RW) {
+        /* read cycle : only the nibble phase matters */
+        if (four_bit)
+            phase ^= 1;
+        return;
+    }
+
+    if (!four_bit) {
+        /* 8-bit mode, D3..D0 are not wired and read as 0 */
+        if (rs)
+            data_write(nibble);
+        else
+            instruction(nibble);
+        return;
+    }
+
+    if (!phase) {
+        high_nibble = nibble;
+        high_rs = rs;
+        phase = 1;
+        return;
+    }
+    phase = 0;
+    if (high_rs)
+        data_write(high_nibble | (nibble >> 4));
+    else
+        instruction(high_nibble | (nibble >> 4));
+}
+
+int main(int argc, char **argv)
+{
+    char buf[256];
+    int opt;
+    int lcd_addr = -1;
+    int last_out = -1;
+    unsigned int last_time = 0;
+    int have_time = 0;
+
+    while ((opt = getopt(argc, argv, "a:c:r:t:")) != -1) {
+        switch (opt) {
+        case 'a': lcd_addr = (int)strtol(optarg, NULL, 0) & 0xFE; break;
+        case 'c': cols = atoi(optarg); break;
+        case 'r': rows = atoi(optarg); break;
+        case 't': ns_per_tick = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-a addr] [-c cols] [-r rows] [-t ns] < dump\n", argv[0]);
+            return 2;
+        }
+    }
+    if (cols < 1 || cols > 40 || rows < 1 || rows > 4) {
+        fprintf(stderr, "unsupported geometry %dx%d\n", cols, rows);
+        return 2;
+    }
+
+    memset(ddram, ' ', sizeof(ddram));
+
+    while (fgets(buf, sizeof(buf), stdin)) {
+        unsigned int addr, data, flags, time;
+
+        if (sscanf(buf, "T %x %x %x %x", &addr, &data, &flags, &time) != 4)
+            continue;
+
+        /* 16-bit time stamps, gaps longer than one wrap are lost */
+        if (have_time)
+            now_ticks += (time - last_time) & 0xFFFF;
+        last_time = time;
+        have_time = 1;
+
+        n_bytes++;
+        if (flags & TRACE_NACK)
+            n_nack++;
+        if (flags & TRACE_ADDR) {
+            if (lcd_addr < 0 && !(addr & 1))
+                lcd_addr = addr;
+            continue;
+        }
+        if ((int)addr != lcd_addr)
+            continue;
+
+        if (last_out >= 0 && !(data & PIN_EN) && (last_out & PIN_EN))
+            strobe((unsigned char)last_out);
+        else if (last_out == (int)data)
+            n_idle_writes++, warn("expander write without effect", data);
+        last_out = data;
+    }
+    if (dirty)
+        print_screen();
+
+    printf("\n%lu bytes on the bus, %lu NACKed\n", n_bytes, n_nack);
+    printf("%lu instructions, %lu characters\n", n_cmds, n_data);
+    printf("wasted: %lu redundant cursor sets, %lu unchanged characters, %lu idle expander writes\n",
+           n_redundant_set, n_same_char, n_idle_writes);
+    /* every LCD instruction or character is 4 expander transactions of 2 bytes */
+    printf("        about %lu of %lu bytes\n",
+           (n_redundant_set + n_same_char) * 8 + n_idle_writes * 2, n_bytes);
+    return 0;
+}
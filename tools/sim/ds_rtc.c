@@ -0,0 +1,181 @@
+/*
+ * File:   ds_rtc.c
+ *
+ * Simulated DS1307 / DS3231 real time clock for the host tests.
+ *
+ * Modelled : BCD time keeping in 24 hour mode through the calendar (month
+ * lengths, leap years, DS3231 century bit), the register pointer with its
+ * wrap, the time registers latched on every START, the divider reset on a
+ * seconds write, the DS1307 clock halt bit and the 1 Hz square wave with
+ * its falling edge on the seconds increment. Not modelled : 12 hour mode,
+ * alarms, the faster SQW rates, temperature and aging registers.
+ */
+
+#include <string.h>
+#include "ds_rtc.h"
+
+#define DS_NS_PER_S     1000000000ULL
+
+static unsigned char DS_From_BCD(unsigned char bcd){
+    return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static unsigned char DS_To_BCD(unsigned char bin){
+    return (unsigned char)(((bin / 10) << 4) | (bin % 10));
+}
+
+static unsigned char DS_Reg_Count(const DS_Rtc *rtc){
+    return rtc->model == 1307 ? 0x40 : 0x13;
+}
+
+static int DS_Running(const DS_Rtc *rtc){
+    return rtc->model == 3231 || !(rtc->regs[0x00] & 0x80);  // DS3231 on VCC never stops
+}
+
+/*******************************************************************************
+ * Function:        static void DS_Rtc_Second(DS_Rtc *rtc)
+ * Description:     One seconds increment, carried through the calendar
+ ******************************************************************************/
+static void DS_Rtc_Second(DS_Rtc *rtc){
+    static const unsigned char days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    unsigned char *r = rtc->regs;
+    unsigned char v, month, year, last;
+
+    v = DS_From_BCD(r[0] & 0x7F) + 1;
+    r[0] = (r[0] & 0x80) | DS_To_BCD(v % 60);
+    if(v < 60) return;
+    v = DS_From_BCD(r[1] & 0x7F) + 1;
+    r[1] = DS_To_BCD(v % 60);
+    if(v < 60) return;
+    v = DS_From_BCD(r[2] & 0x3F) + 1;
+    r[2] = DS_To_BCD(v % 24);
+    if(v < 24) return;
+
+    r[3] = (r[3] & 0x07) % 7 + 1;
+    month = DS_From_BCD(r[5] & 0x1F);
+    year = DS_From_BCD(r[6]);
+    last = month >= 1 && month <= 12 ? days[month - 1] : 31;
+    if(month == 2 && year % 4 == 0)
+        last = 29;                                  // 2000..2099, every fourth year
+    v = DS_From_BCD(r[4] & 0x3F) + 1;
+    if(v <= last){
+        r[4] = DS_To_BCD(v);
+        return;
+    }
+    r[4] = 0x01;
+    if(month < 12){
+        r[5] = (r[5] & 0x80) | DS_To_BCD(month + 1);
+        return;
+    }
+    r[5] = (r[5] & 0x80) | 0x01;
+    if(year < 99){
+        r[6] = DS_To_BCD(year + 1);
+        return;
+    }
+    r[6] = 0x00;
+    if(rtc->model == 3231)
+        r[5] ^= 0x80;                               // century
+}
+
+/*******************************************************************************
+ * Function:        void DS_Rtc_Update(DS_Rtc *rtc)
+ * Description:     Counts the simulated time passed since the last update
+ ******************************************************************************/
+void DS_Rtc_Update(DS_Rtc *rtc){
+    unsigned long long now = sim_now_ns();
+
+    if(DS_Running(rtc)){
+        rtc->sub_ns += now - rtc->last_ns;
+        while(rtc->sub_ns >= DS_NS_PER_S){
+            rtc->sub_ns -= DS_NS_PER_S;
+            DS_Rtc_Second(rtc);
+        }
+    }
+    rtc->last_ns = now;
+}
+
+/*******************************************************************************
+ * Function:        int DS_Rtc_SQW(DS_Rtc *rtc)
+ * Description:     Level of the SQW pin, 1 = released (pulled up)
+ * Remarks:         1 Hz : low for the first half of each second, so the
+ *                  falling edge marks the increment
+ ******************************************************************************/
+int DS_Rtc_SQW(DS_Rtc *rtc){
+    unsigned char ctrl;
+
+    DS_Rtc_Update(rtc);
+    if(rtc->model == 1307){
+        ctrl = rtc->regs[0x07];
+        if(!(ctrl & 0x10))                          // SQWE off : OUT level
+            return (ctrl & 0x80) != 0;
+        if(ctrl & 0x03)                             // faster rates not modelled
+            return 1;
+    }else{
+        ctrl = rtc->regs[0x0E];
+        if(ctrl & 0x04)                             // INTCN : alarm output, no alarms
+            return 1;
+        if(ctrl & 0x18)
+            return 1;
+    }
+    return rtc->sub_ns >= DS_NS_PER_S / 2;
+}
+
+static void DS_Rtc_Start(Sim_Device *dev, int read){
+    DS_Rtc *rtc = (DS_Rtc *)dev;
+
+    DS_Rtc_Update(rtc);
+    memcpy(rtc->latch, rtc->regs, sizeof(rtc->latch));
+    rtc->first = !read;
+}
+
+static int DS_Rtc_Write(Sim_Device *dev, unsigned char byte){
+    DS_Rtc *rtc = (DS_Rtc *)dev;
+
+    if(rtc->first){
+        rtc->ptr = byte % DS_Reg_Count(rtc);
+        rtc->first = 0;
+        return 1;
+    }
+    if(rtc->ptr == 0x00){
+        DS_Rtc_Update(rtc);
+        rtc->sub_ns = 0;                            // divider chain reset
+    }
+    rtc->regs[rtc->ptr] = byte;
+    rtc->ptr = (rtc->ptr + 1) % DS_Reg_Count(rtc);
+    return 1;
+}
+
+static unsigned char DS_Rtc_Read(Sim_Device *dev){
+    DS_Rtc *rtc = (DS_Rtc *)dev;
+    unsigned char v = rtc->ptr < sizeof(rtc->latch) ? rtc->latch[rtc->ptr] : rtc->regs[rtc->ptr];
+
+    rtc->ptr = (rtc->ptr + 1) % DS_Reg_Count(rtc);
+    return v;
+}
+
+/*******************************************************************************
+ * Function:        void DS_Rtc_Init(DS_Rtc *rtc, int model)
+ * Description:     First power up : registers at their data sheet defaults
+ * Parameters:      model = 1307 (clock halted) or 3231 (running, OSF set)
+ ******************************************************************************/
+void DS_Rtc_Init(DS_Rtc *rtc, int model){
+    memset(rtc, 0, sizeof(*rtc));
+    rtc->dev.addr = DS_RTC_ADDR;
+    rtc->dev.present = 1;
+    rtc->dev.start = DS_Rtc_Start;
+    rtc->dev.write = DS_Rtc_Write;
+    rtc->dev.read = DS_Rtc_Read;
+    rtc->model = model;
+    rtc->last_ns = sim_now_ns();
+
+    rtc->regs[0x03] = 0x01;
+    rtc->regs[0x04] = 0x01;
+    rtc->regs[0x05] = 0x01;
+    if(model == 1307){
+        rtc->regs[0x00] = 0x80;                     // CH
+        rtc->regs[0x07] = 0x03;
+    }else{
+        rtc->regs[0x0E] = 0x1C;                     // INTCN, RS2:RS1 = 11
+        rtc->regs[0x0F] = 0x88;                     // OSF, EN32kHz
+    }
+}
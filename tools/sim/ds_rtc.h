@@ -0,0 +1,37 @@
+/*
+ * File:   ds_rtc.h
+ *
+ * Simulated DS1307 / DS3231 real time clock for the host tests.
+ */
+
+#ifndef DS_RTC_H
+#define	DS_RTC_H
+
+#include "sim.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define DS_RTC_ADDR     (0x68 << 1)
+
+typedef struct {
+    Sim_Device dev;                 // first, the MSSP model hands back this
+    int model;                      // 1307 or 3231
+    unsigned char regs[64];         // 0x00..0x3F on the DS1307, 0x00..0x12 used on the DS3231
+    unsigned char latch[7];         // time registers copied on START
+    unsigned char ptr;              // register pointer
+    int first;                      // next write byte is the register pointer
+    unsigned long long last_ns;     // simulated time already counted
+    unsigned long long sub_ns;      // into the current second
+} DS_Rtc;
+
+void DS_Rtc_Init(DS_Rtc *rtc, int model);
+void DS_Rtc_Update(DS_Rtc *rtc);
+int DS_Rtc_SQW(DS_Rtc *rtc);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* DS_RTC_H */
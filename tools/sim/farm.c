@@ -0,0 +1,690 @@
+/*
+ * File:   farm.c
+ *
+ * Simulation farm : the whole firmware, main loop and interrupt routine
+ * included, run on thousands of simulated boards at once against the
+ * simulated PIC18F25K22 (sim.c), LCD backpack (pcf_lcd.c) and RTC
+ * (ds_rtc.c), each board pressed by its own randomized button timeline and
+ * hit by random power cuts.
+ *
+ *   farm [-n instances] [-m minutes] [-j workers] [-s seed] [-p cycles]
+ *        [-w seconds] [-r instance]
+ *
+ *   -n   boards to run (1000)
+ *   -m   simulated minutes per board (30)
+ *   -j   worker processes (all online cores)
+ *   -s   seed of the randomized timelines (1)
+ *   -p   instruction cycles charged per polled register access outside
+ *        the interrupt routine, see sim_poll_cycles (64)
+ *   -w   wall clock seconds one boot may take before it counts as hung (120)
+ *   -r   replay one board, with a line per boot
+ *
+ * Every board is a record in shared memory : its data EEPROM, RTC, button
+ * timeline, random state and results. A worker takes the next board and
+ * forks one child per boot, so the firmware starts from its power on
+ * statics every time, as after a real power cycle. The child runs until
+ * the board's time is up or a power cut, writes the record back and exits.
+ * Board n only depends on the seed and n, so -r n replays what the farm saw.
+ *
+ * Checked on every board :
+ *   - one digit lit at a time, never while MSSP2 has segments b/c, and it
+ *     shows 0-9 (0-5 on the minute tens), a letter of OVEr in its place,
+ *     or nothing
+ *   - the relay is off when OVEr comes up on the digits
+ *   - at every power cut and at the end, the EEPROM digits are in range
+ *     once the init flag is set, and a checkpoint record that passes its
+ *     check holds at most 99:59 and no more than the intact total record
+ *     next to it; after an HLVD warning with enough hold up time for the
+ *     record, the record is intact; a countdown that rode out a supply dip
+ *     has the HLVD interrupt armed again within FARM_REARM_NS
+ *   - the firmware's own INVARIANT checks (INVARIANT_CHECKS=1)
+ *   - no I2C protocol error (mssp.c), no LCD instruction while busy or
+ *     outside DDRAM, and no LCD resync (a resync means the firmware lost
+ *     track of the address counter with nothing garbling the bus)
+ *   - no hang and no crash
+ *
+ * Exit status 0 when every board passed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim.h"
+#include "ds_rtc.h"
+#include "pcf_lcd.h"
+#include "../../eeprom.h"
+#include "../../checkpoint.h"
+#include "../../invariant.h"
+
+#define MS                  1000000ULL
+#define SECOND              (1000 * MS)
+#define MINUTE              (60 * SECOND)
+
+#define FARM_EDGES          16          // one press : start, up to 7 edges down and 7 up
+#define FARM_HOLD_UP_NS     (18 * MS)   // interrupted write + 3 record bytes at 4 ms, with margin
+#define FARM_REARM_NS       (2 * SECOND) // HLVD armed again this long after a dip
+#define FARM_SAMPLES        8           // board ids listed per failure kind
+
+/* Failure kinds */
+#define FARM_F_DIGIT        0x0001      // digit pattern outside its range
+#define FARM_F_RELAY        0x0002      // OVEr came up with the relay on
+#define FARM_F_EEPROM       0x0004      // stored digits out of range
+#define FARM_F_CHECKPOINT   0x0008      // checkpoint record out of range or lost
+#define FARM_F_INVARIANT    0x0010      // firmware INVARIANT failed
+#define FARM_F_I2C          0x0020      // I2C protocol error
+#define FARM_F_LCD          0x0040      // LCD instruction while busy or outside DDRAM
+#define FARM_F_RESYNC       0x0080      // LCD resync with nothing garbling the bus
+#define FARM_F_HANG         0x0100      // boot over its wall clock budget
+#define FARM_F_CRASH        0x0200      // child died on a signal
+#define FARM_KINDS          10
+
+static const char *const farm_kind_name[FARM_KINDS] = {
+    "digit pattern", "relay on at OVEr", "EEPROM digits", "checkpoint record",
+    "firmware invariant", "I2C protocol", "LCD timing / address", "LCD resync",
+    "hang", "crash"
+};
+
+typedef struct {
+    unsigned long long at_ns;           // board time
+    unsigned char buttons;              // RC0..RC2 pressed from then on
+} Farm_Edge;
+
+typedef struct {
+    /* carried from boot to boot */
+    unsigned long long rng;
+    unsigned long long time_ns;         // board time at the start of the boot
+    unsigned char eeprom[SIM_EEPROM_SIZE];
+    int rtc_model;                      // 0 : no RTC fitted
+    DS_Rtc rtc;
+    unsigned char lcd_addr;             // 0 : no LCD fitted
+    Farm_Edge edges[FARM_EDGES];        // button timeline, generated ahead
+    int edge_next, edge_count;
+    unsigned char buttons;
+    int burst;                          // presses left in this burst of activity
+
+    /* results */
+    unsigned long boots, cuts, expiries;
+    unsigned long ee_writes, i2c_bytes, isrs;
+    unsigned long i2c_errors, lcd_errors, lcd_resyncs;
+    unsigned int inv_count;
+    unsigned char inv_first;
+    unsigned int failures;              // FARM_F_*
+    unsigned long long fail_ns;         // board time of the first failure
+    char fail_detail[48];
+} Farm_Board;
+
+typedef struct {
+    unsigned long next;                 // next board to hand out
+    Farm_Board board[];
+} Farm_Shared;
+
+static Farm_Shared *farm;
+static unsigned long farm_boards = 1000;
+static unsigned long long farm_length_ns = 30 * MINUTE;
+static unsigned long long farm_seed = 1;
+static unsigned long farm_poll = 64;
+static unsigned int farm_watchdog_s = 120;
+static int farm_verbose;
+
+/* Child state, one boot */
+static Farm_Board *fb;
+static Pcf_Lcd lcd;
+static unsigned char shown[4];          // pattern last seen on each digit
+static int over_shown;
+static int relay_seen;                  // relay on since the last OVEr
+static int hlvd_armed;                  // HLVD interrupt enabled at the trip
+static unsigned long long hlvd_trip_ns;
+static unsigned long long hlvd_back_ns; // end of the last dip the board rode out, 0 for none
+static unsigned long long boot_end_ns;  // the board's time is up
+
+void firmware_main(void);               // main.c, built with -Dmain=firmware_main
+void isr(void);
+
+/*********** R A N D O M ******************************************************/
+static unsigned long long Farm_Mix(unsigned long long x){
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static unsigned long long Farm_Rand(void){
+    unsigned long long x = fb->rng;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    fb->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform in lo .. hi */
+static unsigned long long Farm_Range(unsigned long long lo, unsigned long long hi){
+    return lo + Farm_Rand() % (hi - lo + 1);
+}
+
+static int Farm_Percent(int p){
+    return (int)(Farm_Rand() % 100) < p;
+}
+
+/*********** F A I L U R E S **************************************************/
+static void Farm_Fail(unsigned int kind, const char *detail, unsigned int value){
+    if(!fb->failures){
+        fb->fail_ns = fb->time_ns + sim_now_ns();
+        snprintf(fb->fail_detail, sizeof(fb->fail_detail), "%s 0x%02X", detail, value);
+    }
+    fb->failures |= kind;
+}
+
+/*********** B U T T O N S ****************************************************/
+static void Farm_Edge_Add(unsigned long long *t, unsigned long long after_ns, unsigned char buttons){
+    *t += after_ns;
+    fb->edges[fb->edge_count].at_ns = *t;
+    fb->edges[fb->edge_count].buttons = buttons;
+    fb->edge_count++;
+}
+
+/*******************************************************************************
+ * Function:        static void Farm_Bounce(unsigned long long *t, unsigned char from, unsigned char to)
+ * Description:     A contact that chatters for a few ms before it settles
+ ******************************************************************************/
+static void Farm_Bounce(unsigned long long *t, unsigned char from, unsigned char to){
+    int n = Farm_Percent(50) ? (int)Farm_Range(1, 3) : 0;
+
+    while(n--){
+        Farm_Edge_Add(t, Farm_Range(200000, 2 * MS), to);
+        Farm_Edge_Add(t, Farm_Range(200000, 2 * MS), from);
+    }
+    Farm_Edge_Add(t, Farm_Range(200000, 2 * MS), to);
+}
+
+/*******************************************************************************
+ * Function:        static void Farm_Next_Press(void)
+ * Description:     Appends the next press to the timeline
+ * Remarks:         Presses come in bursts with short gaps, bursts are
+ *                  separated by quiet spells long enough for short
+ *                  countdowns to run out
+ ******************************************************************************/
+static void Farm_Next_Press(void){
+    static const unsigned char single[3] = {0x01, 0x02, 0x04};
+    static const unsigned char chord[3] = {0x03, 0x05, 0x06};
+    unsigned long long t = fb->edges[fb->edge_count - 1].at_ns;
+    unsigned long long wait, hold;
+    unsigned char b;
+    int r;
+
+    fb->edge_next = fb->edge_count = 0;
+    if(fb->burst > 0){
+        fb->burst--;
+        wait = Farm_Percent(80) ? Farm_Range(50 * MS, 1500 * MS) : Farm_Range(1500 * MS, 30 * SECOND);
+    }else{
+        fb->burst = (int)Farm_Range(1, 12);
+        wait = Farm_Percent(90) ? Farm_Range(30 * SECOND, 4 * MINUTE) : Farm_Range(4 * MINUTE, 10 * MINUTE);
+    }
+
+    r = (int)(Farm_Rand() % 100);
+    b = r < 3 ? chord[Farm_Rand() % 3] : single[r < 25 ? 0 : r < 60 ? 1 : 2];
+    hold = Farm_Percent(80) ? Farm_Range(40 * MS, 300 * MS) : Farm_Range(600 * MS, 4 * SECOND);
+
+    fb->edges[0].at_ns = t;
+    fb->edges[0].buttons = 0;
+    fb->edge_count = 1;
+    t += wait;
+    Farm_Bounce(&t, 0, b);
+    t += hold;
+    Farm_Bounce(&t, b, 0);
+}
+
+static void Farm_Input(int port, Sim_SFR *reg){
+    unsigned long long now;
+
+    if(port != 2)
+        return;
+    now = fb->time_ns + sim_now_ns();
+    while(fb->edges[fb->edge_next].at_ns <= now){
+        fb->buttons = fb->edges[fb->edge_next].buttons;
+        if(++fb->edge_next == fb->edge_count)
+            Farm_Next_Press();
+    }
+    reg->byte = (reg->byte & 0xF8) | (unsigned char)(~fb->buttons & 0x07);  // active low
+    if(fb->rtc_model)
+        reg->portc.RC7 = DS_Rtc_SQW(&fb->rtc);
+}
+
+/*********** D I S P L A Y ****************************************************/
+/*******************************************************************************
+ * Function:        static void Farm_Observe(void)
+ * Description:     Decodes the lit digit after every interrupt
+ * Remarks:         Segments b/c are RB1/RB2, shared with MSSP2 : a digit
+ *                  must never be lit while the MSSP has them
+ ******************************************************************************/
+static void Farm_Observe(void){
+    static const unsigned char segment[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+    static const unsigned char over[4] = {0x3F, 0x3E, 0x79, 0x50};
+    unsigned char lit = LATA & 0x0F, pattern;
+    int d, v, relay = LATCbits.LATC3;
+
+    fb->isrs++;
+    relay_seen |= relay;
+    if(!T2CONbits.TMR2ON){              // scan stopped, the digits are dark
+        memset(shown, 0, sizeof(shown));
+        over_shown = 0;
+        return;
+    }
+    if(!lit)
+        return;
+    if(lit & (lit - 1)){
+        Farm_Fail(FARM_F_DIGIT, "digits lit together", lit);
+        return;
+    }
+    if(SSP2CON1bits.SSPEN){
+        Farm_Fail(FARM_F_DIGIT, "digit lit while MSSP2 has b/c", lit);
+        return;
+    }
+
+    d = lit == 1 ? 0 : lit == 2 ? 1 : lit == 4 ? 2 : 3;
+    pattern = LATB;
+    if(pattern == shown[d])
+        return;
+    shown[d] = pattern;
+
+    for(v = 0; v < 10; v++)
+        if((pattern & 0x7F) == segment[v])
+            break;
+    if(pattern != 0x00 && pattern != over[d] && (v == 10 || (d == 2 && v > 5)))
+        Farm_Fail(FARM_F_DIGIT, d == 2 ? "minute tens shows" : "digit shows", pattern);
+
+    if((memcmp(shown, over, sizeof(shown)) == 0) != over_shown){
+        over_shown = !over_shown;
+        if(over_shown){
+            if(relay)
+                Farm_Fail(FARM_F_RELAY, "relay on at OVEr", LATC);
+            if(relay_seen)
+                fb->expiries++;         // OVEr after the relay ran : a countdown expired
+            relay_seen = 0;
+        }
+    }
+}
+
+/*********** E E P R O M ******************************************************/
+static int Farm_Digits_Valid(const unsigned char *d){
+    return d[0] <= 9 && d[1] <= 9 && d[2] <= 5 && d[3] <= 9;
+}
+
+/*******************************************************************************
+ * Function:        static int Farm_Checkpoint(const unsigned char *ee, unsigned char addr, unsigned long *seconds)
+ * Description:     Decodes a checkpoint record as checkpoint.c does
+ * Return Values:   1 if the record passes its check nibble
+ ******************************************************************************/
+static int Farm_Checkpoint(const unsigned char *ee, unsigned char addr, unsigned long *seconds){
+    unsigned long rec = ee[addr] | (unsigned long)ee[addr + 1] << 8 |
+                        (unsigned long)ee[addr + 2] << 16;
+    unsigned char sum = 5;
+    int i;
+
+    for(i = 0; i < 5; i++)
+        sum += (rec >> (4 * i)) & 0x0F;
+    *seconds = rec & CKP_MAX_SECONDS;
+    return (rec >> 20) == (sum & 0x0FU);
+}
+
+static void Farm_Check_EEPROM(int cut){
+    const unsigned char *ee = sim_eeprom;
+    unsigned long seconds, total;
+    int valid = Farm_Checkpoint(ee, EE_CHECKPOINT, &seconds);
+
+    if(ee[EE_INIT_FLAG] == 1 && !Farm_Digits_Valid(&ee[EE_HOUR_FIRST]))
+        Farm_Fail(FARM_F_EEPROM, "stored digits", ee[EE_HOUR_FIRST] << 4 | ee[EE_MINUTE_FIRST]);
+    if(valid && seconds > 99 * 3600UL + 59 * 60)
+        Farm_Fail(FARM_F_CHECKPOINT, "checkpoint seconds", (unsigned int)(seconds >> 8));
+    if(valid && seconds && (!Farm_Checkpoint(ee, EE_CHECKPOINT_TOTAL, &total) || total < seconds))
+        Farm_Fail(FARM_F_CHECKPOINT, "checkpoint total", (unsigned int)(total >> 8));
+    if(cut && hlvd_armed && sim_now_ns() - hlvd_trip_ns >= FARM_HOLD_UP_NS && !valid)
+        Farm_Fail(FARM_F_CHECKPOINT, "checkpoint lost after HLVD", ee[EE_CHECKPOINT + 2]);
+}
+
+/*********** B O O T **********************************************************/
+/*******************************************************************************
+ * Function:        static void Farm_End(int cut)
+ * Description:     Ends the boot : board time up or the supply gone
+ * Remarks:         A byte write cut short leaves the old or the new value
+ ******************************************************************************/
+static void Farm_End(int cut){
+    unsigned char addr, data;
+    int i;
+
+    if(cut && sim_eeprom_pending(&addr, &data) && Farm_Percent(50))
+        sim_eeprom[addr] = data;
+    Farm_Check_EEPROM(cut);
+
+    if(Invariant_Count()){
+        if(!fb->inv_count)
+            fb->inv_first = Invariant_First();
+        fb->inv_count += Invariant_Count();
+        Farm_Fail(FARM_F_INVARIANT, "INVARIANT code", Invariant_First());
+    }
+    if(sim_i2c_errors())
+        Farm_Fail(FARM_F_I2C, "I2C protocol errors", (unsigned int)sim_i2c_errors());
+    if(fb->lcd_addr){
+        if(lcd.errors)
+            Farm_Fail(FARM_F_LCD, "LCD errors", (unsigned int)lcd.errors);
+        if(lcd.resyncs)
+            Farm_Fail(FARM_F_RESYNC, "LCD resyncs", (unsigned int)lcd.resyncs);
+        fb->lcd_errors += lcd.errors;
+        fb->lcd_resyncs += lcd.resyncs;
+    }
+    fb->i2c_errors += sim_i2c_errors();
+    fb->i2c_bytes += sim_i2c_bytes();
+    for(i = 0; i < SIM_EEPROM_SIZE; i++)
+        fb->ee_writes += sim_eeprom_writes[i];
+
+    memcpy(fb->eeprom, sim_eeprom, sizeof(fb->eeprom));
+    fb->time_ns += sim_now_ns();
+    fb->cuts += cut;
+
+    if(farm_verbose){
+        char row[2][17];
+
+        Pcf_Lcd_Row(&lcd, 0, row[0], 16);
+        Pcf_Lcd_Row(&lcd, 1, row[1], 16);
+        row[0][16] = row[1][16] = 0;
+        printf("  boot %lu : %8.3f s, %s, EEPROM %X%X:%X%X flag %02X%s%s%s%s%s\n",
+               fb->boots, sim_now_ns() / 1e9, cut ? "power cut" : "time up",
+               fb->eeprom[EE_HOUR_FIRST], fb->eeprom[EE_HOUR_SECOND], fb->eeprom[EE_MINUTE_FIRST],
+               fb->eeprom[EE_MINUTE_SECOND], fb->eeprom[EE_INIT_FLAG],
+               fb->lcd_addr ? ", LCD \"" : "", fb->lcd_addr ? row[0] : "",
+               fb->lcd_addr ? "\" \"" : "", fb->lcd_addr ? row[1] : "", fb->lcd_addr ? "\"" : "");
+        fflush(stdout);
+    }
+    _exit(0);
+}
+
+static void Farm_Time_Up(void){
+    Farm_End(0);
+}
+
+static void Farm_Cut(void){
+    Farm_End(1);
+}
+
+static void Farm_Supply(void);
+static void Farm_Recover(void);
+
+/*******************************************************************************
+ * Function:        static void Farm_HLVD(void)
+ * Description:     The supply drops through the HLVD level
+ * Remarks:         Most drops end in a power cut, some are dips the board
+ *                  rides out. A countdown that survived a dip must have
+ *                  the interrupt armed again by the next one.
+ ******************************************************************************/
+static void Farm_HLVD(void){
+    unsigned long seconds;
+    unsigned char addr, data;
+
+    hlvd_armed = PIE2bits.HLVDIE;
+    hlvd_trip_ns = sim_now_ns();
+    if(hlvd_back_ns && hlvd_trip_ns - hlvd_back_ns >= FARM_REARM_NS && !hlvd_armed && LATCbits.LATC3 &&
+       Farm_Checkpoint(sim_eeprom, EE_CHECKPOINT, &seconds) && seconds && !sim_eeprom_pending(&addr, &data))
+        Farm_Fail(FARM_F_CHECKPOINT, "HLVD not re-armed", (unsigned int)((hlvd_trip_ns - hlvd_back_ns) / MS));
+    sim_hlvd_trip();
+    if(Farm_Percent(40))
+        sim_alarm(hlvd_trip_ns + Farm_Range(MS, 50 * MS), Farm_Recover);
+    else
+        sim_alarm(hlvd_trip_ns + Farm_Range(2 * MS, 20 * MS), Farm_Cut);
+}
+
+static void Farm_Recover(void){
+    unsigned long long next;
+
+    hlvd_back_ns = sim_now_ns();
+    sim_hlvd_recover();
+    next = hlvd_back_ns + Farm_Range(FARM_REARM_NS, 90 * SECOND);   // a weak supply dips again soon
+    if(next < boot_end_ns)
+        sim_alarm(next, Farm_HLVD);
+    else
+        sim_alarm(boot_end_ns, Farm_Time_Up);
+}
+
+/*******************************************************************************
+ * Function:        static void Farm_Supply(void)
+ * Description:     Sets the next supply event : a drop, or the time up
+ ******************************************************************************/
+static void Farm_Supply(void){
+    unsigned long long cut = sim_now_ns();
+
+    /* most boots lose their supply at some point, some of them while starting */
+    cut += Farm_Percent(10) ? Farm_Range(100 * MS, 8 * SECOND) : Farm_Range(2 * SECOND, 12 * MINUTE);
+    if(Farm_Percent(60) && cut < boot_end_ns)
+        sim_alarm(cut, Farm_HLVD);
+    else
+        sim_alarm(boot_end_ns, Farm_Time_Up);
+}
+
+/*******************************************************************************
+ * Function:        static void Farm_Boot(void)
+ * Description:     Child : power up the board and run the firmware
+ * Remarks:         Never returns, Farm_End exits when the boot is over
+ ******************************************************************************/
+static void Farm_Boot(void){
+
+    sim_reset();
+    sim_poll_cycles = farm_poll;
+    memcpy(sim_eeprom, fb->eeprom, sizeof(sim_eeprom));
+    memset(sim_eeprom_writes, 0, sizeof(sim_eeprom_writes));
+    sim_input = Farm_Input;
+    sim_isr = isr;
+    sim_after_isr = Farm_Observe;
+
+    if(fb->rtc_model){
+        fb->rtc.last_ns = 0;            // keeps its time, the time off is not simulated
+        sim_i2c_attach(SIM_BUS2, &fb->rtc.dev);
+    }
+    if(fb->lcd_addr){
+        Pcf_Lcd_Init(&lcd, fb->lcd_addr);
+        sim_i2c_attach(SIM_BUS2, &lcd.dev);
+    }
+
+    boot_end_ns = farm_length_ns - fb->time_ns;
+    Farm_Supply();
+
+    alarm(farm_watchdog_s);
+    firmware_main();
+    Farm_Fail(FARM_F_CRASH, "main returned", 0);
+    Farm_End(0);
+}
+
+/*******************************************************************************
+ * Function:        static void Farm_Board_Run(unsigned long n)
+ * Description:     Worker : one board from power on to the end of its time
+ ******************************************************************************/
+static void Farm_Board_Run(unsigned long n){
+    pid_t pid;
+    int status;
+
+    fb = &farm->board[n];
+    memset(fb, 0, sizeof(*fb));
+    fb->rng = Farm_Mix(farm_seed * 0x100000001B3ULL + n) | 1;
+
+    /* the board as it left the factory, or with a short time already set */
+    memset(fb->eeprom, 0xFF, sizeof(fb->eeprom));
+    if(Farm_Percent(50)){
+        fb->eeprom[EE_HOUR_FIRST] = 0;
+        fb->eeprom[EE_HOUR_SECOND] = 0;
+        fb->eeprom[EE_MINUTE_FIRST] = 0;
+        fb->eeprom[EE_MINUTE_SECOND] = (unsigned char)Farm_Range(1, 3);
+        fb->eeprom[EE_INIT_FLAG] = 1;
+    }
+    fb->rtc_model = Farm_Percent(20) ? 0 : Farm_Percent(50) ? 3231 : 1307;
+    if(fb->rtc_model)
+        DS_Rtc_Init(&fb->rtc, fb->rtc_model);
+    fb->lcd_addr = Farm_Percent(10) ? 0 : Farm_Percent(50) ? 0x27 << 1 : 0x3F << 1;
+
+    fb->edges[0].at_ns = 0;
+    fb->edges[0].buttons = 0;
+    fb->edge_count = 1;
+    Farm_Next_Press();
+
+    if(farm_verbose)
+        printf("board %lu : RTC %d, LCD 0x%02X, EEPROM %s\n", n, fb->rtc_model, fb->lcd_addr >> 1,
+               fb->eeprom[EE_INIT_FLAG] == 1 ? "set" : "erased");
+
+    while(fb->time_ns < farm_length_ns && !(fb->failures & (FARM_F_HANG | FARM_F_CRASH))){
+        fb->boots++;
+        fflush(stdout);
+        pid = fork();
+        if(pid == 0)
+            Farm_Boot();
+        if(pid < 0 || waitpid(pid, &status, 0) < 0){
+            perror("farm");
+            exit(2);
+        }
+        if(WIFSIGNALED(status)){
+            if(!fb->failures){
+                fb->fail_ns = fb->time_ns;
+                snprintf(fb->fail_detail, sizeof(fb->fail_detail), "boot %lu, signal %d", fb->boots, WTERMSIG(status));
+            }
+            fb->failures |= WTERMSIG(status) == SIGALRM ? FARM_F_HANG : FARM_F_CRASH;
+        }
+    }
+}
+
+static void Farm_Worker(void){
+    unsigned long n;
+
+    while((n = __atomic_fetch_add(&farm->next, 1, __ATOMIC_RELAXED)) < farm_boards)
+        Farm_Board_Run(n);
+}
+
+/*********** R E P O R T ******************************************************/
+static void Farm_Report(int workers, double wall){
+    unsigned long n, boots = 0, cuts = 0, expiries = 0, ee_writes = 0, bytes = 0, isrs = 0;
+    unsigned long count[FARM_KINDS] = {0}, failed = 0;
+    unsigned long long simulated = 0;
+    const Farm_Board *b;
+    int k, listed;
+
+    for(n = 0; n < farm_boards; n++){
+        b = &farm->board[n];
+        simulated += b->time_ns;
+        boots += b->boots;
+        cuts += b->cuts;
+        expiries += b->expiries;
+        ee_writes += b->ee_writes;
+        bytes += b->i2c_bytes;
+        isrs += b->isrs;
+        failed += b->failures != 0;
+        for(k = 0; k < FARM_KINDS; k++)
+            count[k] += (b->failures >> k) & 1;
+    }
+
+    printf("%lu boards x %llu min, %d workers, %lu cycles per poll\n",
+           farm_boards, farm_length_ns / MINUTE, workers, farm_poll);
+    printf("  %.1f s wall, %.1f simulated device-hours, %.2f device-hours/s, %.0f x real time per core\n",
+           wall, simulated / 3.6e12, simulated / 3.6e12 / wall, simulated / 1e9 / wall / workers);
+    printf("  %lu boots, %lu power cuts, %lu countdowns expired\n", boots, cuts, expiries);
+    printf("  %lu EEPROM writes, %lu I2C bytes, %lu interrupts\n", ee_writes, bytes, isrs);
+
+    for(k = 0; k < FARM_KINDS; k++){
+        if(!count[k])
+            continue;
+        printf("  FAIL %-22s %lu boards :", farm_kind_name[k], count[k]);
+        for(n = 0, listed = 0; n < farm_boards && listed < FARM_SAMPLES; n++)
+            if(farm->board[n].failures & (1U << k)){
+                printf(" %lu", n);
+                listed++;
+            }
+        printf("\n");
+    }
+    printf(failed ? "FAILED, %lu boards (replay one with -r)\n" : "passed\n", failed);
+}
+
+static void Farm_Replay_Report(unsigned long n){
+    const Farm_Board *b = &farm->board[n];
+
+    printf("board %lu : %lu boots, %lu power cuts, %lu countdowns expired, %lu EEPROM writes\n",
+           n, b->boots, b->cuts, b->expiries, b->ee_writes);
+    printf("  I2C %lu bytes %lu errors, LCD %lu errors %lu resyncs, INVARIANT %u (first %u)\n",
+           b->i2c_bytes, b->i2c_errors, b->lcd_errors, b->lcd_resyncs, b->inv_count, b->inv_first);
+    if(b->failures)
+        printf("  first failure at %.3f s : %s\nFAILED\n", b->fail_ns / 1e9, b->fail_detail);
+    else
+        printf("passed\n");
+}
+
+static void Farm_Usage(void){
+    fprintf(stderr, "usage : farm [-n instances] [-m minutes] [-j workers] [-s seed] [-p cycles] [-w seconds] [-r instance]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    long replay = -1;
+    struct timespec t0, t1;
+    int opt, w, status, failed = 0;
+    unsigned long n;
+
+    while((opt = getopt(argc, argv, "n:m:j:s:p:w:r:")) != -1){
+        switch(opt){
+        case 'n': farm_boards = strtoul(optarg, NULL, 0); break;
+        case 'm': farm_length_ns = strtoull(optarg, NULL, 0) * MINUTE; break;
+        case 'j': workers = strtol(optarg, NULL, 0); break;
+        case 's': farm_seed = strtoull(optarg, NULL, 0); break;
+        case 'p': farm_poll = strtoul(optarg, NULL, 0); break;
+        case 'w': farm_watchdog_s = (unsigned int)strtoul(optarg, NULL, 0); break;
+        case 'r': replay = strtol(optarg, NULL, 0); break;
+        default: Farm_Usage();
+        }
+    }
+    if(!farm_boards || !farm_length_ns || !farm_poll || replay >= (long)farm_boards)
+        Farm_Usage();
+    if(workers < 1)
+        workers = 1;
+    if((unsigned long)workers > farm_boards)
+        workers = (long)farm_boards;
+
+    farm = mmap(NULL, sizeof(Farm_Shared) + farm_boards * sizeof(Farm_Board),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(farm == MAP_FAILED){
+        perror("farm");
+        return 2;
+    }
+
+    if(replay >= 0){
+        farm_verbose = 1;
+        Farm_Board_Run((unsigned long)replay);
+        Farm_Replay_Report((unsigned long)replay);
+        return farm->board[replay].failures != 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(w = 0; w < workers; w++){
+        pid_t pid = fork();
+
+        if(pid == 0){
+            Farm_Worker();
+            _exit(0);
+        }
+        if(pid < 0){
+            perror("farm");
+            return 2;
+        }
+    }
+    while(wait(&status) > 0)
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if(failed){
+        fprintf(stderr, "farm : a worker failed\n");
+        return 2;
+    }
+    Farm_Report((int)workers, (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    for(n = 0; n < farm_boards; n++)
+        if(farm->board[n].failures)
+            return 1;
+    return 0;
+}
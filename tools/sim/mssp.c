@@ -0,0 +1,169 @@
+/*
+ * File:   mssp.c
+ *
+ * Simulated MSSP master, the I2C_HOST backend of i2c.c.
+ *
+ * i2c.c triggers every bus event the way it does on the part (SEN, RSEN,
+ * PEN, RCEN or ACKEN in SSPxCON2, or a write to SSPxBUF) and then waits for
+ * SSPxIF. Under I2C_HOST that wait first calls I2C_Host_Event, which plays
+ * the event against the devices attached to the bus, lets the bus time
+ * pass and sets SSPxIF, ACKSTAT and SSPxBUF as the MSSP would.
+ *
+ * Sequences the MSSP or the slaves would not accept (a transfer outside
+ * START .. STOP, a read without a read address, a missing or extra
+ * acknowledge, the module not in I2C master mode, two events at once) are
+ * counted in sim_i2c_errors() and otherwise ignored.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "sim.h"
+#include "i2c.h"
+
+typedef struct {
+    Sim_Device *devices;
+    Sim_Device *current;        // addressed and acknowledging
+    int open;                   // between START and STOP
+    int addressing;             // next byte written is an address
+    int reading;                // addressed for read
+    int ack_due;                // byte received, ACKEN expected
+    int last_ack;               // 1 if the last received byte was acknowledged
+} Sim_Bus;
+
+static Sim_Bus sim_bus[2];
+static unsigned long sim_errors;
+static unsigned long sim_bytes;
+
+void sim_i2c_reset(void){
+    memset(sim_bus, 0, sizeof(sim_bus));
+    sim_errors = 0;
+    sim_bytes = 0;
+}
+
+void sim_i2c_attach(int bus, Sim_Device *dev){
+    dev->next = sim_bus[bus - 1].devices;
+    sim_bus[bus - 1].devices = dev;
+}
+
+unsigned long sim_i2c_errors(void){
+    return sim_errors;
+}
+
+unsigned long sim_i2c_bytes(void){
+    return sim_bytes;
+}
+
+/*******************************************************************************
+ * Function:        static void Sim_Bus_Time(const I2C_Bus *bus, unsigned bits)
+ * Description:     Lets bits SCL periods pass at the SSPxADD baud rate
+ ******************************************************************************/
+static void Sim_Bus_Time(const I2C_Bus *bus, unsigned bits){
+    sim_cycles((unsigned long)bits * (*bus->add + 1));
+}
+
+static void Sim_Bus_Release(Sim_Bus *sb){
+    if(sb->current && sb->current->stop)
+        sb->current->stop(sb->current);
+    sb->current = NULL;
+}
+
+/*******************************************************************************
+ * Function:        static int Sim_Bus_Address(Sim_Bus *sb, unsigned char byte)
+ * Description:     Address byte after a START, returns 1 for ACK
+ ******************************************************************************/
+static int Sim_Bus_Address(Sim_Bus *sb, unsigned char byte){
+    Sim_Device *dev;
+
+    for(dev = sb->devices; dev; dev = dev->next)
+        if(dev->present && dev->addr == (byte & 0xFE))
+            break;
+    if(sb->current != dev)
+        Sim_Bus_Release(sb);
+    sb->current = dev;
+    sb->reading = byte & 0x01;
+    if(!dev)
+        return 0;
+    if(dev->start)
+        dev->start(dev, sb->reading);
+    return 1;
+}
+
+/*******************************************************************************
+ * Function:        void I2C_Host_Idle(void)
+ * Description:     One polled access worth of time, for i2c.c waits on RAM
+ ******************************************************************************/
+void I2C_Host_Idle(void){
+    sim_cycles(sim_poll_cycles);
+}
+
+/*******************************************************************************
+ * Function:        void I2C_Host_Event(const I2C_Bus *bus)
+ * Description:     Completes the bus event i2c.c has just triggered
+ * Precondition:    Called by I2C_Wait before it polls SSPxIF
+ * Parameters:      bus = MSSP bus handle
+ * Return Values:   None
+ * Remarks:         None
+ ******************************************************************************/
+void I2C_Host_Event(const I2C_Bus *bus){
+    Sim_Bus *sb = &sim_bus[bus->con1 == &SSP2CON1 ? SIM_BUS2 - 1 : SIM_BUS1 - 1];
+    unsigned char con2 = *bus->con2;
+    unsigned char cmd = con2 & (I2C_SEN | I2C_RSEN | I2C_PEN | I2C_RCEN | I2C_ACKEN);
+    int ack;
+
+    if((*bus->con1 & 0x2F) != 0x28)                 // SSPEN, SSPM = I2C master
+        sim_errors++;
+    if(cmd & (cmd - 1))                             // more than one event
+        sim_errors++;
+
+    if(cmd & I2C_SEN){
+        if(sb->open)
+            sim_errors++;
+        sb->open = 1;
+        sb->addressing = 1;
+        sb->ack_due = 0;
+        Sim_Bus_Time(bus, 1);
+    }else if(cmd & I2C_RSEN){
+        if(!sb->open || sb->ack_due)
+            sim_errors++;
+        sb->addressing = 1;
+        Sim_Bus_Time(bus, 1);
+    }else if(cmd & I2C_PEN){
+        if(!sb->open || sb->ack_due || (sb->reading && sb->last_ack))
+            sim_errors++;                           // the slave still drives SDA
+        Sim_Bus_Release(sb);
+        sb->open = 0;
+        sb->reading = 0;
+        sb->last_ack = 0;
+        Sim_Bus_Time(bus, 1);
+    }else if(cmd & I2C_RCEN){
+        if(!sb->open || !sb->reading || sb->addressing || sb->ack_due)
+            sim_errors++;
+        *bus->buf = sb->current && sb->current->read ? sb->current->read(sb->current) : 0xFF;
+        sb->ack_due = 1;
+        sim_bytes++;
+        Sim_Bus_Time(bus, 8);
+    }else if(cmd & I2C_ACKEN){
+        if(!sb->ack_due)
+            sim_errors++;
+        sb->ack_due = 0;
+        sb->last_ack = !(con2 & I2C_ACKDT);
+        Sim_Bus_Time(bus, 1);
+    }else{
+        /* no event bit : SSPxBUF was written, a byte goes out */
+        if(!sb->open || sb->ack_due || (sb->reading && !sb->addressing))
+            sim_errors++;
+        if(sb->addressing){
+            ack = Sim_Bus_Address(sb, *bus->buf);
+            sb->addressing = 0;
+            sb->last_ack = 0;
+        }else{
+            ack = sb->current && sb->current->write ? sb->current->write(sb->current, *bus->buf) : 0;
+        }
+        con2 = ack ? (con2 & ~I2C_ACKSTAT) : (con2 | I2C_ACKSTAT);
+        sim_bytes++;
+        Sim_Bus_Time(bus, 9);
+    }
+
+    *bus->con2 = con2 & (unsigned char)~cmd;        // the MSSP clears the event bit
+    *bus->pir |= bus->if_mask;
+}
@@ -0,0 +1,159 @@
+/*
+ * File:   pcf_lcd.c
+ *
+ * Simulated HD44780 character LCD behind a PCF8574 backpack for the host
+ * tests.
+ *
+ * Modelled : the PCF8574 quasi-bidirectional port (P0 RS, P1 RW, P2 E,
+ * P3 backlight, P7..P4 on D7..D4), the controller latching a nibble on the
+ * falling edge of E, 8-bit mode after power on and the function set to
+ * 4-bit mode, the busy flag with the instruction execution times, the
+ * address counter with its wrap between the two 40 character lines, the
+ * busy flag / address counter read in two nibbles, CGRAM writes and the
+ * 15 ms power on delay. Not modelled : data reads, entry mode decrement,
+ * display shift (it does not move the address counter).
+ */
+
+#include <string.h>
+#include "pcf_lcd.h"
+
+#define PCF_RS          0x01
+#define PCF_RW          0x02
+#define PCF_E           0x04
+
+#define LCD_NS_POWER_ON 15000000ULL
+#define LCD_NS_CLEAR    1520000ULL
+#define LCD_NS_CMD      37000ULL
+#define LCD_NS_DATA     41000ULL
+
+static int Pcf_Lcd_Busy(const Pcf_Lcd *lcd){
+    return sim_now_ns() < lcd->busy_until;
+}
+
+static unsigned char Pcf_Lcd_Next(unsigned char ac){
+    if(ac == 0x27)
+        return 0x40;
+    if(ac == 0x67)
+        return 0x00;
+    return ac + 1;
+}
+
+/*******************************************************************************
+ * Function:        static void Pcf_Lcd_Exec(Pcf_Lcd *lcd, int rs, unsigned char byte)
+ * Description:     Runs one instruction (rs = 0) or data write (rs = 1)
+ ******************************************************************************/
+static void Pcf_Lcd_Exec(Pcf_Lcd *lcd, int rs, unsigned char byte){
+    unsigned long long ns = LCD_NS_CMD;
+
+    if(Pcf_Lcd_Busy(lcd))
+        lcd->errors++;                              // lost or garbled on the part
+
+    if(rs){
+        if(lcd->cgram){
+            lcd->cgram_data[lcd->ac] = byte;
+            lcd->ac = (lcd->ac + 1) & 0x3F;
+        }else{
+            lcd->ddram[lcd->ac] = byte;
+            lcd->ac = Pcf_Lcd_Next(lcd->ac);
+        }
+        ns = LCD_NS_DATA;
+    }else if(byte & 0x80){                          // set DDRAM address
+        lcd->ac = byte & 0x7F;
+        lcd->cgram = 0;
+        if((lcd->ac & 0x3F) > 0x27)
+            lcd->errors++;
+    }else if(byte & 0x40){                          // set CGRAM address
+        lcd->ac = byte & 0x3F;
+        lcd->cgram = 1;
+    }else if(byte & 0x20){                          // function set
+        if(byte & 0x10){
+            if(!lcd->eight_bit && lcd->initialised)
+                lcd->resyncs++;
+            lcd->eight_bit = 1;
+        }else{
+            lcd->eight_bit = 0;
+            lcd->initialised = 1;
+        }
+        lcd->phase = 0;
+    }else if(byte & 0x10){                          // cursor or display shift
+        if(!(byte & 0x08) && !lcd->cgram)
+            lcd->ac = (byte & 0x04) ? Pcf_Lcd_Next(lcd->ac) : (lcd->ac ? lcd->ac - 1 : 0);
+    }else if(byte & 0x03){                          // clear or return home
+        if(byte & 0x01)
+            memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+        lcd->ac = 0;
+        lcd->cgram = 0;
+        ns = LCD_NS_CLEAR;
+    }
+    /* entry mode and display control : nothing the tests look at */
+
+    lcd->busy_until = sim_now_ns() + ns;
+}
+
+/*******************************************************************************
+ * Function:        static unsigned char Pcf_Lcd_Status(const Pcf_Lcd *lcd)
+ * Description:     Busy flag and address counter, the next nibble of it on D7..D4
+ ******************************************************************************/
+static unsigned char Pcf_Lcd_Status(const Pcf_Lcd *lcd){
+    unsigned char bf_ac = (Pcf_Lcd_Busy(lcd) ? 0x80 : 0x00) | lcd->ac;
+
+    return (lcd->eight_bit || !lcd->phase) ? (bf_ac & 0xF0) : (unsigned char)(bf_ac << 4);
+}
+
+static int Pcf_Lcd_Write(Sim_Device *dev, unsigned char byte){
+    Pcf_Lcd *lcd = (Pcf_Lcd *)dev;
+    unsigned char old = lcd->pins;
+
+    lcd->pins = byte;
+
+    if(!(old & PCF_E) && (byte & PCF_E) && (byte & PCF_RW)){
+        lcd->drive = (byte & PCF_RS) ? 0xF0 : Pcf_Lcd_Status(lcd);
+    }else if((old & PCF_E) && !(byte & PCF_E)){
+        if(old & PCF_RW){
+            lcd->drive = 0xF0;                      // read cycle over, pins released
+            if(!lcd->eight_bit)
+                lcd->phase ^= 1;
+        }else if(lcd->eight_bit){
+            Pcf_Lcd_Exec(lcd, old & PCF_RS, old & 0xF0);    // D3..D0 are not wired
+        }else if(!lcd->phase){
+            lcd->high = old & 0xF0;
+            lcd->phase = 1;
+        }else{
+            lcd->phase = 0;
+            Pcf_Lcd_Exec(lcd, old & PCF_RS, lcd->high | (old >> 4));
+        }
+    }
+    return 1;
+}
+
+static unsigned char Pcf_Lcd_Read(Sim_Device *dev){
+    Pcf_Lcd *lcd = (Pcf_Lcd *)dev;
+
+    return lcd->pins & (lcd->drive | 0x0F);         // a pin written high reads what pulls it low
+}
+
+/*******************************************************************************
+ * Function:        void Pcf_Lcd_Init(Pcf_Lcd *lcd, unsigned char addr)
+ * Description:     Power up : PCF8574 pins high, controller busy for 15 ms
+ * Parameters:      addr = 8-bit write address of the backpack
+ ******************************************************************************/
+void Pcf_Lcd_Init(Pcf_Lcd *lcd, unsigned char addr){
+    memset(lcd, 0, sizeof(*lcd));
+    lcd->dev.addr = addr;
+    lcd->dev.present = 1;
+    lcd->dev.write = Pcf_Lcd_Write;
+    lcd->dev.read = Pcf_Lcd_Read;
+    lcd->pins = 0xFF;
+    lcd->drive = 0xF0;
+    lcd->eight_bit = 1;
+    memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+    lcd->busy_until = sim_now_ns() + LCD_NS_POWER_ON;
+}
+
+/*******************************************************************************
+ * Function:        void Pcf_Lcd_Row(const Pcf_Lcd *lcd, int line, char *text, int len)
+ * Description:     The first len characters of a DDRAM line (0 or 1)
+ ******************************************************************************/
+void Pcf_Lcd_Row(const Pcf_Lcd *lcd, int line, char *text, int len){
+    memcpy(text, &lcd->ddram[line ? 0x40 : 0x00], len);
+}
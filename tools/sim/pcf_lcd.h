@@ -0,0 +1,41 @@
+/*
+ * File:   pcf_lcd.h
+ *
+ * Simulated HD44780 character LCD behind a PCF8574 backpack for the host
+ * tests.
+ */
+
+#ifndef PCF_LCD_H
+#define	PCF_LCD_H
+
+#include "sim.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    Sim_Device dev;                 // first, the MSSP model hands back this
+    unsigned char pins;             // PCF8574 output latch : D7..D4 BL E RW RS
+    unsigned char drive;            // D7..D4 as driven by the LCD, 0xF0 when released
+    int eight_bit;                  // interface width, 8 bits after power on
+    int phase;                      // 4-bit mode : 1 after the high nibble
+    unsigned char high;             // high nibble waiting for its low half
+    int initialised;                // 4-bit mode set once
+    unsigned char ac;               // address counter
+    int cgram;                      // ac addresses CGRAM
+    unsigned char ddram[0x80];
+    unsigned char cgram_data[0x40];
+    unsigned long long busy_until;  // simulated ns
+    unsigned long errors;           // instruction while busy, DDRAM address outside the lines
+    unsigned long resyncs;          // back to 8-bit mode after initialisation
+} Pcf_Lcd;
+
+void Pcf_Lcd_Init(Pcf_Lcd *lcd, unsigned char addr);
+void Pcf_Lcd_Row(const Pcf_Lcd *lcd, int line, char *text, int len);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PCF_LCD_H */
@@ -0,0 +1,168 @@
+/*
+ * File:   rtc_test.c
+ *
+ * Host test of rtc.c + i2c.c against a simulated DS1307 / DS3231 on the
+ * simulated MSSP2. Built once per RTC_MODEL, see Makefile.
+ *
+ * Exit status 0 when every check passed.
+ */
+
+#include <stdio.h>
+#include "sim.h"
+#include "ds_rtc.h"
+#include "../../i2c.h"
+#include "../../clock.h"
+#include "../../rtc.h"
+
+#define MS  1000000ULL
+
+static int failures;
+static DS_Rtc ds;
+static DS_Rtc *sqw_source;          // drives RC7 when set
+static unsigned long bus_bytes, bus_errors;     // over all tests, sim_reset clears the bus counters
+
+#define CHECK(cond) do{ \
+        if(!(cond)){ printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+    }while(0)
+
+static void Sqw_Input(int port, Sim_SFR *reg){
+    if(port == 2)
+        reg->portc.RC7 = sqw_source ? DS_Rtc_SQW(sqw_source) : 1;
+}
+
+/*******************************************************************************
+ * Function:        static void Setup(int present)
+ * Description:     Fresh part at 64 MHz, MSSP2 up, RTC attached or not
+ ******************************************************************************/
+static void Setup(int present){
+    bus_bytes += sim_i2c_bytes();
+    bus_errors += sim_i2c_errors();
+    sim_reset();
+    sim_input = Sqw_Input;
+    sqw_source = NULL;
+    Clock_Set(CLOCK_16MHZ);         // Clock_Set skips the speed it thinks is set
+    Clock_Set(CLOCK_64MHZ);
+    I2C_Init(&I2C_BUS2);
+    if(present){
+        DS_Rtc_Init(&ds, RTC_MODEL);
+        sim_i2c_attach(SIM_BUS2, &ds.dev);
+        sqw_source = &ds;
+    }
+}
+
+static void Test_Absent(void){
+    unsigned int s0;
+    int i;
+
+    printf("absent RTC, tick fallback\n");
+    Setup(0);
+    CHECK(RTC_Init() == 0);
+    CHECK(!RTC_Present());
+
+    s0 = RTC_Seconds();
+    for(i = 0; i < 999; i++)
+        RTC_Tick(1);
+    CHECK(RTC_Seconds() == s0);
+    RTC_Tick(1);
+    CHECK(RTC_Seconds() == s0 + 1);
+    for(i = 0; i < 250; i++)        // 4 ms ticks at 1 MHz
+        RTC_Tick(4);
+    CHECK(RTC_Seconds() == s0 + 2);
+}
+
+static void Test_Init(void){
+    printf("init : oscillator and 1 Hz output\n");
+    Setup(1);
+    ds.regs[0x00] = (RTC_MODEL == 1307 ? 0x80 : 0x00) | 0x42;
+    CHECK(RTC_Init() == 1);
+    CHECK(RTC_Present());
+    CHECK(ds.regs[RTC_REG_CONTROL] == RTC_CONTROL_1HZ);
+    CHECK(ds.regs[0x00] == 0x42);   // DS1307 : CH cleared, seconds kept
+
+    sim_advance_ns(1000 * MS);
+    DS_Rtc_Update(&ds);
+    CHECK(ds.regs[0x00] == 0x43);   // and the clock runs
+}
+
+static void Test_Roundtrip(void){
+    RTC_Time set = {59, 59, 23, 7, 31, 12, 99};
+    RTC_Time leap = {59, 59, 23, 3, 28, 2, 24};
+    RTC_Time got;
+
+    printf("write / read, calendar rollover\n");
+    Setup(1);
+    CHECK(RTC_Init());
+    CHECK(RTC_Write(&set));
+    CHECK(RTC_Read(&got));
+    CHECK(got.seconds == 59 && got.minutes == 59 && got.hours == 23);
+    CHECK(got.day == 7 && got.date == 31 && got.month == 12 && got.year == 99);
+
+    sim_advance_ns(1000 * MS);
+    CHECK(RTC_Read(&got));
+    CHECK(got.seconds == 0 && got.minutes == 0 && got.hours == 0);
+    CHECK(got.day == 1 && got.date == 1 && got.month == 1 && got.year == 0);
+    if(RTC_MODEL == 3231)
+        CHECK(ds.regs[0x05] & 0x80);    // century
+
+    CHECK(RTC_Write(&leap));
+    sim_advance_ns(1000 * MS);
+    CHECK(RTC_Read(&got));
+    CHECK(got.date == 29 && got.month == 2);
+    leap.year = 23;
+    CHECK(RTC_Write(&leap));
+    sim_advance_ns(1000 * MS);
+    CHECK(RTC_Read(&got));
+    CHECK(got.date == 1 && got.month == 3);
+}
+
+static void Test_SQW(void){
+    RTC_Time set = {0, 0, 12, 1, 1, 1, 24};
+    RTC_Time got;
+    unsigned int s0;
+    int ms;
+
+    printf("SQW seconds\n");
+    Setup(1);
+    CHECK(RTC_Init());
+    CHECK(RTC_Write(&set));         // divider reset : increments on the whole seconds from here
+    RTC_Tick(1);                    // the reset itself pulls SQW low, not counted below
+    s0 = RTC_Seconds();
+    for(ms = 0; ms < 10500; ms++){
+        sim_advance_ns(MS);
+        RTC_Tick(1);
+    }
+    CHECK(RTC_Seconds() == s0 + 10);
+    CHECK(RTC_Read(&got));
+    CHECK(got.seconds == 10);
+}
+
+static void Test_Gone(void){
+    RTC_Time set = {1, 2, 3, 4, 5, 6, 7};
+    RTC_Time got = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+
+    printf("RTC removed : NACK\n");
+    Setup(1);
+    CHECK(RTC_Init());
+    ds.dev.present = 0;
+    CHECK(RTC_Read(&got) == 0);
+    CHECK(got.seconds == 0xAA && got.year == 0xAA);
+    CHECK(RTC_Write(&set) == 0);
+    ds.dev.present = 1;
+    CHECK(RTC_Read(&got) == 1);
+}
+
+int main(void){
+    printf("rtc_test, RTC_MODEL %d\n", RTC_MODEL);
+    Test_Absent();
+    Test_Init();
+    Test_Roundtrip();
+    Test_SQW();
+    Test_Gone();
+
+    bus_bytes += sim_i2c_bytes();
+    bus_errors += sim_i2c_errors();
+    printf("%lu bytes on the bus, %lu protocol errors\n", bus_bytes, bus_errors);
+    CHECK(bus_errors == 0);
+    printf(failures ? "FAILED, %d checks\n" : "passed\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,544 @@
+/*
+ * File:   sim.c
+ *
+ * Simulated PIC18F25K22 core : register file, time, oscillator, timers,
+ * interrupts, data EEPROM and HLVD.
+ *
+ * Time only passes where the firmware would spend it waiting : on every
+ * polled register access (sim_poll_cycles instruction cycles, the fixed
+ * SIM_POLL_CYCLES inside the interrupt routine) and for every I2C event at
+ * the bus rate. The timers run on that time, in steps that end on every
+ * flag they raise, and an enabled interrupt is taken as soon as its flag
+ * is set, so the tick and the display scan see no more latency than the
+ * firmware itself causes.
+ *
+ * Writes to plain registers cannot be seen as they happen. A timer whose
+ * TMRx or TxCON no longer holds what the model left there was written by
+ * the firmware, which clears its prescaler and postscaler as on the part.
+ */
+
+#include <string.h>
+#include "sim.h"
+
+Sim_SFR sim_sfr[SIM_SFR_COUNT];
+unsigned short sim_tmr1, sim_tmr3;
+unsigned long sim_poll_cycles = SIM_POLL_CYCLES;
+Sim_Input_Fn sim_input;
+Sim_ISR_Fn sim_isr;
+Sim_ISR_Fn sim_after_isr;
+unsigned char sim_eeprom[SIM_EEPROM_SIZE];
+unsigned long sim_eeprom_writes[SIM_EEPROM_SIZE];
+
+/* 8-bit timer with period register, prescaler and postscaler (Timer2, Timer4) */
+typedef struct {
+    int con, tmr, pr;               // register file indices
+    int pir;
+    unsigned char if_mask;
+    unsigned long pre;              // instruction cycles into the prescaler
+    unsigned char post;             // periods since the last flag
+    unsigned char tmr_seen, con_seen;
+} Sim_Timer8;
+
+/* 16-bit timer (Timer1, Timer3), instruction or system clock only */
+typedef struct {
+    int con;
+    unsigned short *tmr;
+    int pir;
+    unsigned char if_mask;
+    unsigned long pre;              // clock edges into the prescaler
+    unsigned short tmr_seen;
+    unsigned char con_seen;
+} Sim_Timer16;
+
+static Sim_Timer8 sim_t2, sim_t4;
+static Sim_Timer16 sim_t1, sim_t3;
+
+/* Timer0, 8-bit mode from FOSC/4 only */
+static unsigned long sim_t0_pre;
+static unsigned char sim_t0_seen, sim_t0con_seen;
+
+/*
+ * Time is counted in instruction cycles since the last clock change and
+ * only turned into ns when asked for, the clock registers are compared
+ * on every step to see the change.
+ */
+static unsigned long long sim_epoch_ns;         // time of the last clock change
+static unsigned long long sim_epoch_cycles;     // instruction cycles since then
+static unsigned long sim_hz = 1000000UL;        // FOSC since then, 1 MHz out of reset
+static unsigned char sim_osccon_seen, sim_osctune_seen;
+static unsigned long long sim_alarm_ns;
+static unsigned long long sim_alarm_cycles;     // sim_alarm_ns in sim_epoch_cycles
+static Sim_Alarm_Fn sim_alarm_fn;
+static int sim_in_isr;
+
+static int sim_vdd_low;                         // supply below the HLVD level
+static int sim_ee_busy;
+static unsigned long long sim_ee_done_ns;
+static unsigned char sim_ee_addr, sim_ee_data;
+
+/*******************************************************************************
+ * Function:        void sim_reset(void)
+ * Description:     Power on reset of the register file, time back to 0
+ * Remarks:         The EEPROM array keeps its contents, as on the part
+ ******************************************************************************/
+void sim_reset(void){
+    memset(sim_sfr, 0, sizeof(sim_sfr));
+    sim_tmr1 = sim_tmr3 = 0;
+    sim_epoch_ns = 0;
+    sim_epoch_cycles = 0;
+    sim_alarm_ns = SIM_NEVER;
+    sim_alarm_cycles = SIM_NEVER;
+    sim_alarm_fn = NULL;
+    sim_in_isr = 0;
+    sim_vdd_low = 0;
+    sim_ee_busy = 0;
+    sim_i2c_reset();
+
+    sim_sfr[SIM_TRISA].byte = 0xFF;
+    sim_sfr[SIM_TRISB].byte = 0xFF;
+    sim_sfr[SIM_TRISC].byte = 0xFF;
+    sim_sfr[SIM_ANSELA].byte = 0x2F;
+    sim_sfr[SIM_ANSELB].byte = 0x3F;
+    sim_sfr[SIM_ANSELC].byte = 0xFC;
+    sim_sfr[SIM_OSCCON].byte = 0x30;    // 1 MHz HFINTOSC
+    sim_sfr[SIM_T0CON].byte = 0xFF;     // T0CKI pin, not counting
+    sim_sfr[SIM_PR2].byte = 0xFF;
+    sim_sfr[SIM_PR4].byte = 0xFF;
+    sim_sfr[SIM_TXSTA1].byte = 0x02;    // TRMT
+    sim_osccon_seen = sim_sfr[SIM_OSCCON].byte;
+    sim_osctune_seen = sim_sfr[SIM_OSCTUNE].byte;
+    sim_hz = sim_fosc();
+
+    sim_t0_pre = 0;
+    sim_t0_seen = sim_t0con_seen = 0;
+    memset(&sim_t2, 0, sizeof(sim_t2));
+    sim_t2.con = SIM_T2CON;
+    sim_t2.tmr = SIM_TMR2;
+    sim_t2.pr = SIM_PR2;
+    sim_t2.pir = SIM_PIR1;
+    sim_t2.if_mask = 0x02;              // TMR2IF
+    memset(&sim_t4, 0, sizeof(sim_t4));
+    sim_t4.con = SIM_T4CON;
+    sim_t4.tmr = SIM_TMR4;
+    sim_t4.pr = SIM_PR4;
+    sim_t4.pir = SIM_PIR5;
+    sim_t4.if_mask = 0x01;              // TMR4IF
+
+    memset(&sim_t1, 0, sizeof(sim_t1));
+    sim_t1.con = SIM_T1CON;
+    sim_t1.tmr = &sim_tmr1;
+    sim_t1.pir = SIM_PIR1;
+    sim_t1.if_mask = 0x01;              // TMR1IF
+    memset(&sim_t3, 0, sizeof(sim_t3));
+    sim_t3.con = SIM_T3CON;
+    sim_t3.tmr = &sim_tmr3;
+    sim_t3.pir = SIM_PIR2;
+    sim_t3.if_mask = 0x02;              // TMR3IF
+}
+
+/*******************************************************************************
+ * Function:        unsigned long long sim_now_ns(void)
+ * Description:     Simulated time since sim_reset
+ ******************************************************************************/
+unsigned long long sim_now_ns(void){
+    return sim_epoch_ns + sim_epoch_cycles / sim_hz * 4000000000ULL +
+           sim_epoch_cycles % sim_hz * 4000000000ULL / sim_hz;
+}
+
+/*******************************************************************************
+ * Function:        unsigned long sim_fosc(void)
+ * Description:     CPU clock from IRCF and PLLEN, HFINTOSC only
+ ******************************************************************************/
+unsigned long sim_fosc(void){
+    static const unsigned long ircf_hz[8] = {
+        31000UL, 250000UL, 500000UL, 1000000UL, 2000000UL, 4000000UL, 8000000UL, 16000000UL
+    };
+    unsigned long hz = ircf_hz[sim_sfr[SIM_OSCCON].osccon.IRCF];
+
+    if(sim_sfr[SIM_OSCTUNE].osctune.PLLEN && hz >= 8000000UL)
+        hz *= 4;
+    return hz;
+}
+
+/*******************************************************************************
+ * Function:        static void Sim_Alarm_Cycles(void)
+ * Description:     First cycle of the epoch at or past sim_alarm_ns
+ ******************************************************************************/
+static void Sim_Alarm_Cycles(void){
+    unsigned long long d;
+
+    if(sim_alarm_ns == SIM_NEVER){
+        sim_alarm_cycles = SIM_NEVER;
+    }else if(sim_alarm_ns <= sim_epoch_ns){
+        sim_alarm_cycles = 0;
+    }else{
+        d = sim_alarm_ns - sim_epoch_ns;
+        sim_alarm_cycles = d / 4000000000ULL * sim_hz + (d % 4000000000ULL * sim_hz + 3999999999ULL) / 4000000000ULL;
+    }
+}
+
+/*******************************************************************************
+ * Function:        static void Sim_Clock_Check(void)
+ * Description:     Starts a new epoch when IRCF or PLLEN changed
+ ******************************************************************************/
+static void Sim_Clock_Check(void){
+    if(sim_sfr[SIM_OSCCON].byte == sim_osccon_seen && sim_sfr[SIM_OSCTUNE].byte == sim_osctune_seen)
+        return;
+    sim_epoch_ns = sim_now_ns();
+    sim_epoch_cycles = 0;
+    sim_osccon_seen = sim_sfr[SIM_OSCCON].byte;
+    sim_osctune_seen = sim_sfr[SIM_OSCTUNE].byte;
+    sim_hz = sim_fosc();
+    Sim_Alarm_Cycles();
+}
+
+/*******************************************************************************
+ * Function:        void sim_alarm(unsigned long long at_ns, Sim_Alarm_Fn fn)
+ * Description:     Calls fn once simulated time reaches at_ns
+ * Remarks:         One alarm at a time, fn may set the next one
+ ******************************************************************************/
+void sim_alarm(unsigned long long at_ns, Sim_Alarm_Fn fn){
+    sim_alarm_ns = at_ns;
+    sim_alarm_fn = fn;
+    Sim_Alarm_Cycles();
+}
+
+/*******************************************************************************
+ * Function:        void sim_advance_ns(unsigned long long ns)
+ * Description:     Lets simulated time pass, whole instruction cycles
+ ******************************************************************************/
+void sim_advance_ns(unsigned long long ns){
+    sim_cycles((unsigned long)((ns * sim_fosc() + 3999999999ULL) / 4000000000ULL));
+}
+
+/*********** T I M E R S ******************************************************/
+/* prescaler as a shift : 1, 4, 16, 16 */
+static unsigned Sim_T8_Prescale(unsigned char con){
+    static const unsigned char shift[4] = {0, 2, 4, 4};
+
+    return shift[con & 0x03];
+}
+
+static void Sim_T8_Written(Sim_Timer8 *t){
+    if(sim_sfr[t->tmr].byte != t->tmr_seen || sim_sfr[t->con].byte != t->con_seen){
+        t->pre = 0;
+        t->post = 0;
+        t->tmr_seen = sim_sfr[t->tmr].byte;
+        t->con_seen = sim_sfr[t->con].byte;
+    }
+}
+
+/*******************************************************************************
+ * Function:        static unsigned long Sim_T8_To_Flag(Sim_Timer8 *t)
+ * Description:     Instruction cycles until the timer raises its flag
+ ******************************************************************************/
+static unsigned long Sim_T8_To_Flag(Sim_Timer8 *t){
+    unsigned char con = sim_sfr[t->con].byte;
+    unsigned tmr = sim_sfr[t->tmr].byte, pr = sim_sfr[t->pr].byte;
+    unsigned long counts;
+
+    if(!(con & 0x04))
+        return ~0UL;
+    Sim_T8_Written(t);
+    counts = tmr <= pr ? pr - tmr + 1 : 256 - tmr + pr + 1;
+    counts += (unsigned long)(((con >> 3) & 0x0F) - t->post) * (pr + 1);
+    return (counts << Sim_T8_Prescale(con)) - t->pre;
+}
+
+static void Sim_T8_Run(Sim_Timer8 *t, unsigned long cycles){
+    unsigned char con = sim_sfr[t->con].byte;
+    unsigned long incs, to_match;
+    unsigned tmr, pr, ps;
+
+    if(!(con & 0x04))
+        return;
+    Sim_T8_Written(t);
+    ps = Sim_T8_Prescale(con);
+    t->pre += cycles;
+    incs = t->pre >> ps;
+    t->pre &= (1UL << ps) - 1;
+
+    tmr = sim_sfr[t->tmr].byte;
+    pr = sim_sfr[t->pr].byte;
+    while(incs){
+        to_match = tmr <= pr ? pr - tmr + 1 : 256 - tmr + pr + 1;
+        if(incs < to_match){
+            tmr += incs;
+            break;
+        }
+        incs -= to_match;
+        tmr = 0;                        // match : reset and one postscaler count
+        if(t->post++ >= ((con >> 3) & 0x0F)){
+            t->post = 0;
+            sim_sfr[t->pir].byte |= t->if_mask;
+        }
+    }
+    sim_sfr[t->tmr].byte = t->tmr_seen = (unsigned char)tmr;
+}
+
+/* prescaler as a shift : PSA set bypasses it, else 1:2 .. 1:256 */
+static unsigned Sim_T0_Prescale(unsigned char con){
+    return (con & 0x08) ? 0 : (con & 0x07) + 1;
+}
+
+static int Sim_T0_On(unsigned char con){
+    return (con & 0xE0) == 0xC0;        // TMR0ON, T08BIT, T0CS = FOSC/4
+}
+
+static void Sim_T0_Written(void){
+    if(sim_sfr[SIM_TMR0L].byte != sim_t0_seen || sim_sfr[SIM_T0CON].byte != sim_t0con_seen){
+        sim_t0_pre = 0;
+        sim_t0_seen = sim_sfr[SIM_TMR0L].byte;
+        sim_t0con_seen = sim_sfr[SIM_T0CON].byte;
+    }
+}
+
+static unsigned long Sim_T0_To_Flag(void){
+    unsigned char con = sim_sfr[SIM_T0CON].byte;
+
+    if(!Sim_T0_On(con))
+        return ~0UL;
+    Sim_T0_Written();
+    return ((256UL - sim_sfr[SIM_TMR0L].byte) << Sim_T0_Prescale(con)) - sim_t0_pre;
+}
+
+static void Sim_T0_Run(unsigned long cycles){
+    unsigned char con = sim_sfr[SIM_T0CON].byte;
+    unsigned long incs;
+    unsigned ps;
+
+    if(!Sim_T0_On(con))
+        return;
+    Sim_T0_Written();
+    ps = Sim_T0_Prescale(con);
+    sim_t0_pre += cycles;
+    incs = sim_t0_pre >> ps;
+    sim_t0_pre &= (1UL << ps) - 1;
+    if(sim_sfr[SIM_TMR0L].byte + incs > 0xFF)
+        sim_sfr[SIM_INTCON].intcon.TMR0IF = 1;
+    sim_sfr[SIM_TMR0L].byte = sim_t0_seen = (unsigned char)(sim_sfr[SIM_TMR0L].byte + incs);
+}
+
+static void Sim_T16_Run(Sim_Timer16 *t, unsigned long cycles){
+    unsigned char con = sim_sfr[t->con].byte;
+    unsigned long edges, incs;
+    unsigned ps;
+
+    if(*t->tmr != t->tmr_seen || con != t->con_seen){
+        t->pre = 0;
+        t->con_seen = con;
+    }
+    if((con & 0x01) && (con & 0xC0) <= 0x40){
+        edges = (con & 0xC0) ? cycles * 4 : cycles;    // TMRxCS = 01 : FOSC
+        ps = (con >> 4) & 0x03;
+        t->pre += edges;
+        incs = t->pre >> ps;
+        t->pre &= (1UL << ps) - 1;
+        if(*t->tmr + incs > 0xFFFF)
+            sim_sfr[t->pir].byte |= t->if_mask;
+        *t->tmr = (unsigned short)(*t->tmr + incs);
+    }
+    t->tmr_seen = *t->tmr;
+}
+
+/*********** I N T E R R U P T S **********************************************/
+static void Sim_HLVD_Check(void){
+    Sim_SFR *con = &sim_sfr[SIM_HLVDCON];
+
+    if(con->hlvdcon.HLVDEN && con->hlvdcon.VDIRMAG != sim_vdd_low)
+        sim_sfr[SIM_PIR2].pir2.HLVDIF = 1;              // VDIRMAG = 0 : below, 1 : above
+}
+
+static int Sim_Pending(void){
+    unsigned char intcon = sim_sfr[SIM_INTCON].byte;
+
+    if(!(intcon & 0x80))
+        return 0;                                       // GIE
+    if(intcon & (intcon >> 3) & 0x07)
+        return 1;                                       // TMR0, INT0, RB : no PEIE needed
+    if(!(intcon & 0x40))
+        return 0;                                       // PEIE
+    return (sim_sfr[SIM_PIE1].byte & sim_sfr[SIM_PIR1].byte) |
+           (sim_sfr[SIM_PIE2].byte & sim_sfr[SIM_PIR2].byte) |
+           (sim_sfr[SIM_PIE3].byte & sim_sfr[SIM_PIR3].byte) |
+           (sim_sfr[SIM_PIE5].byte & sim_sfr[SIM_PIR5].byte);
+}
+
+/*******************************************************************************
+ * Function:        static void Sim_Dispatch(void)
+ * Description:     Takes the pending interrupts, GIE cleared meanwhile
+ * Remarks:         A flag the routine fails to clear is retried a few times
+ *                  only, the next polled access takes it again
+ ******************************************************************************/
+static void Sim_Dispatch(void){
+    int n;
+
+    for(n = 0; n < 8 && !sim_in_isr && Sim_Pending(); n++){
+        sim_in_isr = 1;
+        sim_sfr[SIM_INTCON].intcon.GIE = 0;
+        sim_cycles(SIM_ISR_CYCLES);
+        if(sim_isr)
+            sim_isr();
+        sim_sfr[SIM_INTCON].intcon.GIE = 1;
+        sim_in_isr = 0;
+        if(sim_after_isr)
+            sim_after_isr();
+    }
+}
+
+/*******************************************************************************
+ * Function:        void sim_cycles(unsigned long cycles)
+ * Description:     Lets instruction cycles (FOSC / 4) pass
+ * Remarks:         Runs the timers, the alarm and the interrupts on the way
+ ******************************************************************************/
+void sim_cycles(unsigned long cycles){
+    unsigned long step, n;
+    Sim_Alarm_Fn fn;
+
+    do{
+        Sim_Clock_Check();
+        step = cycles;
+        n = Sim_T0_To_Flag();
+        if(n < step)
+            step = n;
+        n = Sim_T8_To_Flag(&sim_t2);
+        if(n < step)
+            step = n;
+        n = Sim_T8_To_Flag(&sim_t4);
+        if(n < step)
+            step = n;
+        if(sim_alarm_cycles <= sim_epoch_cycles)
+            step = 0;
+        else if(sim_alarm_cycles - sim_epoch_cycles < step)
+            step = (unsigned long)(sim_alarm_cycles - sim_epoch_cycles);
+
+        Sim_T0_Run(step);
+        Sim_T8_Run(&sim_t2, step);
+        Sim_T8_Run(&sim_t4, step);
+        Sim_T16_Run(&sim_t1, step);
+        Sim_T16_Run(&sim_t3, step);
+        sim_epoch_cycles += step;
+        cycles -= step;
+
+        if(sim_epoch_cycles >= sim_alarm_cycles){
+            fn = sim_alarm_fn;
+            sim_alarm(SIM_NEVER, NULL);
+            fn();
+        }
+        Sim_HLVD_Check();
+        Sim_Dispatch();
+    }while(cycles);
+}
+
+/*********** E E P R O M ******************************************************/
+static void Sim_EE_Service(void){
+    Sim_SFR *eecon1 = &sim_sfr[SIM_EECON1];
+
+    if(sim_ee_busy){
+        if(sim_now_ns() < sim_ee_done_ns)
+            return;
+        sim_eeprom[sim_ee_addr] = sim_ee_data;
+        sim_eeprom_writes[sim_ee_addr]++;
+        sim_ee_busy = 0;
+        eecon1->eecon1.WR = 0;
+        sim_sfr[SIM_PIR2].pir2.EEIF = 1;
+    }else if(eecon1->eecon1.WR){
+        if(!eecon1->eecon1.WREN || eecon1->eecon1.EEPGD || eecon1->eecon1.CFGS){
+            eecon1->eecon1.WR = 0;      // not a data EEPROM write, nothing happens
+            return;
+        }
+        sim_ee_busy = 1;
+        sim_ee_done_ns = sim_now_ns() + SIM_EEPROM_WRITE_NS;
+        sim_ee_addr = sim_sfr[SIM_EEADR].byte;
+        sim_ee_data = sim_sfr[SIM_EEDATA].byte;
+    }
+}
+
+/*******************************************************************************
+ * Function:        int sim_eeprom_pending(unsigned char *addr, unsigned char *data)
+ * Description:     The write in progress, for a power cut in the middle of it
+ ******************************************************************************/
+int sim_eeprom_pending(unsigned char *addr, unsigned char *data){
+    if(!sim_ee_busy)
+        return 0;
+    *addr = sim_ee_addr;
+    *data = sim_ee_data;
+    return 1;
+}
+
+/*******************************************************************************
+ * Function:        void sim_hlvd_trip(void)
+ * Description:     The supply falls below the HLVD level
+ * Remarks:         HLVDIF follows the level, as on the part : it is set
+ *                  again after a clear for as long as VDD stays on the side
+ *                  VDIRMAG watches for
+ ******************************************************************************/
+void sim_hlvd_trip(void){
+    sim_vdd_low = 1;
+    Sim_HLVD_Check();
+}
+
+/*******************************************************************************
+ * Function:        void sim_hlvd_recover(void)
+ * Description:     The supply comes back above the HLVD level
+ ******************************************************************************/
+void sim_hlvd_recover(void){
+    sim_vdd_low = 0;
+    Sim_HLVD_Check();
+}
+
+/*******************************************************************************
+ * Function:        Sim_SFR *sim_poll(int sfr)
+ * Description:     Access to a register the firmware waits on
+ * Remarks:         The oscillator and HLVD reference are stable at once
+ ******************************************************************************/
+Sim_SFR *sim_poll(int sfr){
+    unsigned char tris, ansel, lat;
+    int port;
+
+    sim_cycles(sim_in_isr ? SIM_POLL_CYCLES : sim_poll_cycles);
+
+    switch(sfr){
+    case SIM_OSCCON:
+        sim_sfr[SIM_OSCCON].osccon.HFIOFS = 1;
+        break;
+    case SIM_OSCCON2:
+        sim_sfr[SIM_OSCCON2].osccon2.PLLRDY = sim_sfr[SIM_OSCTUNE].osctune.PLLEN;
+        break;
+    case SIM_HLVDCON:
+        sim_sfr[SIM_HLVDCON].hlvdcon.IRVST = sim_sfr[SIM_HLVDCON].hlvdcon.HLVDEN;
+        break;
+    case SIM_EECON1:
+        Sim_EE_Service();
+        break;
+    case SIM_EEDATA:
+        Sim_EE_Service();
+        if(sim_sfr[SIM_EECON1].eecon1.RD){
+            sim_sfr[SIM_EEDATA].byte = sim_eeprom[sim_sfr[SIM_EEADR].byte];
+            sim_sfr[SIM_EECON1].eecon1.RD = 0;
+        }
+        break;
+    case SIM_PORTA:
+    case SIM_PORTB:
+    case SIM_PORTC:
+        port = sfr - SIM_PORTA;
+        tris = sim_sfr[SIM_TRISA + port].byte;
+        ansel = sim_sfr[SIM_ANSELA + port].byte;
+        lat = sim_sfr[SIM_LATA + port].byte;
+        sim_sfr[sfr].byte = 0xFF;       // inputs float high (pull-ups)
+        if(sim_input)
+            sim_input(port, &sim_sfr[sfr]);
+        sim_sfr[sfr].byte = (lat & (unsigned char)~tris) | (sim_sfr[sfr].byte & tris & (unsigned char)~ansel);
+        break;
+    }
+    return &sim_sfr[sfr];
+}
+
+/*******************************************************************************
+ * Function:        unsigned short *sim_poll16(unsigned short *timer)
+ * Description:     Access to a 16-bit timer the firmware waits on
+ ******************************************************************************/
+unsigned short *sim_poll16(unsigned short *timer){
+    sim_cycles(sim_in_isr ? SIM_POLL_CYCLES : sim_poll_cycles);
+    return timer;
+}
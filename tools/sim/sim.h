@@ -0,0 +1,91 @@
+/*
+ * File:   sim.h
+ *
+ * Simulated PIC18F25K22 core for host builds of the firmware : the register
+ * file behind the host xc.h, simulated time, the oscillator, Timer1..4,
+ * interrupts, the data EEPROM, the HLVD and the I2C devices hung on the
+ * simulated MSSP buses.
+ */
+
+#ifndef SIM_H
+#define	SIM_H
+
+#include "xc.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*********** T I M E **********************************************************/
+#define SIM_POLL_CYCLES     8           // default instruction cycles charged per polled access
+#define SIM_ISR_CYCLES      40          // interrupt entry, context save and RETFIE
+#define SIM_NEVER           (~0ULL)
+
+/*
+ * Instruction cycles charged per polled access outside the interrupt
+ * routine. Raising it makes a busy main loop coarser and the simulation
+ * faster; the timers and interrupts stay exact.
+ */
+extern unsigned long sim_poll_cycles;
+
+void sim_reset(void);
+unsigned long long sim_now_ns(void);
+unsigned long sim_fosc(void);
+void sim_advance_ns(unsigned long long ns);
+void sim_cycles(unsigned long cycles);
+
+/* One pending callback at an absolute simulated time, SIM_NEVER for none */
+typedef void (*Sim_Alarm_Fn)(void);
+void sim_alarm(unsigned long long at_ns, Sim_Alarm_Fn fn);
+
+/*********** I N T E R R U P T S **********************************************/
+typedef void (*Sim_ISR_Fn)(void);
+extern Sim_ISR_Fn sim_isr;              // the firmware interrupt routine
+extern Sim_ISR_Fn sim_after_isr;        // observer, called after each interrupt
+
+/*********** P I N S **********************************************************/
+/*
+ * PORTx reads return LATx on outputs and the external level on inputs,
+ * high unless a model pulls it : sim_input is called after that so models
+ * can drive input pins (port = 0 for A).
+ */
+typedef void (*Sim_Input_Fn)(int port, Sim_SFR *reg);
+extern Sim_Input_Fn sim_input;
+
+/*********** D A T A   E E P R O M ********************************************/
+#define SIM_EEPROM_SIZE     256
+#define SIM_EEPROM_WRITE_NS 4000000ULL  // typical byte write time
+
+extern unsigned char sim_eeprom[SIM_EEPROM_SIZE];
+extern unsigned long sim_eeprom_writes[SIM_EEPROM_SIZE];
+int sim_eeprom_pending(unsigned char *addr, unsigned char *data);  // 1 while a write runs
+
+/*********** H L V D **********************************************************/
+void sim_hlvd_trip(void);               // supply falls through the HLVD level
+void sim_hlvd_recover(void);            // and rises through it again
+
+/*********** I 2 C   D E V I C E S ********************************************/
+#define SIM_BUS1            1           // MSSP1
+#define SIM_BUS2            2           // MSSP2, the LCD bus
+
+typedef struct Sim_Device Sim_Device;
+struct Sim_Device {
+    unsigned char addr;                 // 8-bit write address
+    int present;                        // 0 : never acknowledges
+    void (*start)(Sim_Device *dev, int read);           // addressed after a (repeated) START
+    int (*write)(Sim_Device *dev, unsigned char byte);  // returns 1 for ACK
+    unsigned char (*read)(Sim_Device *dev);
+    void (*stop)(Sim_Device *dev);      // STOP, or a START addressing someone else
+    Sim_Device *next;
+};
+
+void sim_i2c_reset(void);               // buses idle, no devices
+void sim_i2c_attach(int bus, Sim_Device *dev);
+unsigned long sim_i2c_errors(void);     // protocol errors seen by the MSSP model
+unsigned long sim_i2c_bytes(void);      // bytes clocked on all buses
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SIM_H */
@@ -0,0 +1,204 @@
+/*
+ * File:   xc.h (host)
+ *
+ * Host stand-in for the XC8 <xc.h> of the PIC18F25K22, for building the
+ * firmware sources on a Linux host (see Makefile in this directory).
+ *
+ * Every special function register the firmware touches is a byte of the
+ * simulated register file sim_sfr[] (sim.c), with the bit layout of the
+ * data sheet, so byte and bit accesses alias as on the part. Plain
+ * registers are addressed directly, which keeps &SSP2CON1 and friends
+ * constant expressions for the I2C_Bus handles in i2c.c. The registers the
+ * firmware busy-waits on go through sim_poll(), which lets the simulated
+ * core advance time and update the status bits first.
+ */
+
+#ifndef SIM_XC_H
+#define	SIM_XC_H
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*********** C O M P I L E R   S H I M S **************************************/
+#define __interrupt(...)
+#define __delay_ms(x)       ((void)0)
+#define __delay_us(x)       ((void)0)
+#define NOP()               ((void)0)
+#define CLRWDT()            ((void)0)
+#define SLEEP()             ((void)0)
+#define ei()                (INTCONbits.GIE = 1)
+#define di()                (INTCONbits.GIE = 0)
+
+/*********** R E G I S T E R   F I L E ****************************************/
+enum {
+    SIM_PORTA, SIM_PORTB, SIM_PORTC,
+    SIM_LATA, SIM_LATB, SIM_LATC,
+    SIM_TRISA, SIM_TRISB, SIM_TRISC,
+    SIM_ANSELA, SIM_ANSELB, SIM_ANSELC,
+    SIM_INTCON, SIM_PIR1, SIM_PIE1, SIM_PIR2, SIM_PIE2, SIM_PIR3, SIM_PIE3,
+    SIM_PIR5, SIM_PIE5,
+    SIM_OSCCON, SIM_OSCCON2, SIM_OSCTUNE,
+    SIM_T0CON, SIM_T1CON, SIM_T2CON, SIM_T3CON, SIM_T4CON,
+    SIM_TMR0L,
+    SIM_TMR2, SIM_PR2, SIM_TMR4, SIM_PR4,
+    SIM_EECON1, SIM_EECON2, SIM_EEADR, SIM_EEDATA,
+    SIM_HLVDCON,
+    SIM_SSP1CON1, SIM_SSP1CON2, SIM_SSP1STAT, SIM_SSP1ADD, SIM_SSP1BUF,
+    SIM_SSP2CON1, SIM_SSP2CON2, SIM_SSP2STAT, SIM_SSP2ADD, SIM_SSP2BUF,
+    SIM_TXSTA1, SIM_RCSTA1, SIM_BAUDCON1, SIM_SPBRG1, SIM_SPBRGH1, SIM_TXREG1,
+    SIM_SFR_COUNT
+};
+
+#define SIM_BITS8(P)    unsigned char P##0:1, P##1:1, P##2:1, P##3:1, P##4:1, P##5:1, P##6:1, P##7:1
+
+typedef union {
+    unsigned char byte;
+    struct { SIM_BITS8(RA); } porta;
+    struct { SIM_BITS8(RB); } portb;
+    struct { SIM_BITS8(RC); } portc;
+    struct { SIM_BITS8(LATA); } lata;
+    struct { SIM_BITS8(LATB); } latb;
+    struct { SIM_BITS8(LATC); } latc;
+    union {
+        struct { SIM_BITS8(TRISA); };
+        struct { SIM_BITS8(RA); };
+    } trisa;
+    union {
+        struct { SIM_BITS8(TRISB); };
+        struct { SIM_BITS8(RB); };
+    } trisb;
+    union {
+        struct { SIM_BITS8(TRISC); };
+        struct { SIM_BITS8(RC); };
+    } trisc;
+    struct { SIM_BITS8(ANSA); } ansela;
+    struct { SIM_BITS8(ANSB); } anselb;
+    struct { SIM_BITS8(ANSC); } anselc;
+    struct { unsigned char RBIF:1, INT0IF:1, TMR0IF:1, RBIE:1, INT0IE:1, TMR0IE:1, PEIE:1, GIE:1; } intcon;
+    struct { unsigned char TMR1IF:1, TMR2IF:1, CCP1IF:1, SSP1IF:1, TX1IF:1, RC1IF:1, ADIF:1, :1; } pir1;
+    struct { unsigned char TMR1IE:1, TMR2IE:1, CCP1IE:1, SSP1IE:1, TX1IE:1, RC1IE:1, ADIE:1, :1; } pie1;
+    struct { unsigned char CCP2IF:1, TMR3IF:1, HLVDIF:1, BCL1IF:1, EEIF:1, C2IF:1, C1IF:1, OSCFIF:1; } pir2;
+    struct { unsigned char CCP2IE:1, TMR3IE:1, HLVDIE:1, BCL1IE:1, EEIE:1, C2IE:1, C1IE:1, OSCFIE:1; } pie2;
+    struct { unsigned char TMR1GIF:1, TMR3GIF:1, TMR5GIF:1, CTMUIF:1, TX2IF:1, RC2IF:1, BCL2IF:1, SSP2IF:1; } pir3;
+    struct { unsigned char TMR1GIE:1, TMR3GIE:1, TMR5GIE:1, CTMUIE:1, TX2IE:1, RC2IE:1, BCL2IE:1, SSP2IE:1; } pie3;
+    struct { unsigned char TMR4IF:1, TMR5IF:1, TMR6IF:1, :5; } pir5;
+    struct { unsigned char TMR4IE:1, TMR5IE:1, TMR6IE:1, :5; } pie5;
+    struct { unsigned char SCS:2, HFIOFS:1, OSTS:1, IRCF:3, IDLEN:1; } osccon;
+    struct { unsigned char LFIOFS:1, MFIOFS:1, PRISD:1, SOSCGO:1, MFIOSEL:1, :1, SOSCRUN:1, PLLRDY:1; } osccon2;
+    struct { unsigned char TUN:6, PLLEN:1, INTSRC:1; } osctune;
+    struct { unsigned char TMR1ON:1, RD16:1, T1SYNC:1, T1SOSCEN:1, T1CKPS:2, TMR1CS:2; } t1con;
+    struct { unsigned char T2CKPS:2, TMR2ON:1, T2OUTPS:4, :1; } t2con;
+    struct { unsigned char TMR3ON:1, RD16:1, T3SYNC:1, T3SOSCEN:1, T3CKPS:2, TMR3CS:2; } t3con;
+    struct { unsigned char T4CKPS:2, TMR4ON:1, T4OUTPS:4, :1; } t4con;
+    struct { unsigned char RD:1, WR:1, WREN:1, WRERR:1, FREE:1, :1, CFGS:1, EEPGD:1; } eecon1;
+    struct { unsigned char HLVDL:4, HLVDEN:1, IRVST:1, BGVST:1, VDIRMAG:1; } hlvdcon;
+    struct { unsigned char SSPM:4, CKP:1, SSPEN:1, SSPOV:1, WCOL:1; } sspcon1;
+    struct { unsigned char TX9D:1, TRMT:1, BRGH:1, SENDB:1, SYNC:1, TXEN:1, TX9:1, CSRC:1; } txsta1;
+} Sim_SFR;
+
+extern Sim_SFR sim_sfr[SIM_SFR_COUNT];
+extern unsigned short sim_tmr1, sim_tmr3;
+
+Sim_SFR *sim_poll(int sfr);             /* time passes, then the register is read */
+unsigned short *sim_poll16(unsigned short *timer);
+
+/* Direct registers : no time passes */
+#define LATA        (sim_sfr[SIM_LATA].byte)
+#define LATB        (sim_sfr[SIM_LATB].byte)
+#define LATC        (sim_sfr[SIM_LATC].byte)
+#define TRISA       (sim_sfr[SIM_TRISA].byte)
+#define TRISB       (sim_sfr[SIM_TRISB].byte)
+#define TRISC       (sim_sfr[SIM_TRISC].byte)
+#define ANSELA      (sim_sfr[SIM_ANSELA].byte)
+#define ANSELB      (sim_sfr[SIM_ANSELB].byte)
+#define ANSELC      (sim_sfr[SIM_ANSELC].byte)
+#define INTCON      (sim_sfr[SIM_INTCON].byte)
+#define PIR1        (sim_sfr[SIM_PIR1].byte)
+#define PIE1        (sim_sfr[SIM_PIE1].byte)
+#define PIR2        (sim_sfr[SIM_PIR2].byte)
+#define PIE2        (sim_sfr[SIM_PIE2].byte)
+#define PIR3        (sim_sfr[SIM_PIR3].byte)
+#define PIE3        (sim_sfr[SIM_PIE3].byte)
+#define PIR5        (sim_sfr[SIM_PIR5].byte)
+#define PIE5        (sim_sfr[SIM_PIE5].byte)
+#define OSCCON      (sim_sfr[SIM_OSCCON].byte)
+#define OSCTUNE     (sim_sfr[SIM_OSCTUNE].byte)
+#define T0CON       (sim_sfr[SIM_T0CON].byte)
+#define T1CON       (sim_sfr[SIM_T1CON].byte)
+#define T2CON       (sim_sfr[SIM_T2CON].byte)
+#define T3CON       (sim_sfr[SIM_T3CON].byte)
+#define T4CON       (sim_sfr[SIM_T4CON].byte)
+#define TMR0L       (sim_sfr[SIM_TMR0L].byte)
+#define PR2         (sim_sfr[SIM_PR2].byte)
+#define PR4         (sim_sfr[SIM_PR4].byte)
+#define EECON2      (sim_sfr[SIM_EECON2].byte)
+#define EEADR       (sim_sfr[SIM_EEADR].byte)
+#define HLVDCON     (sim_sfr[SIM_HLVDCON].byte)
+#define SSP1CON1    (sim_sfr[SIM_SSP1CON1].byte)
+#define SSP1CON2    (sim_sfr[SIM_SSP1CON2].byte)
+#define SSP1STAT    (sim_sfr[SIM_SSP1STAT].byte)
+#define SSP1ADD     (sim_sfr[SIM_SSP1ADD].byte)
+#define SSP1BUF     (sim_sfr[SIM_SSP1BUF].byte)
+#define SSP2CON1    (sim_sfr[SIM_SSP2CON1].byte)
+#define SSP2CON2    (sim_sfr[SIM_SSP2CON2].byte)
+#define SSP2STAT    (sim_sfr[SIM_SSP2STAT].byte)
+#define SSP2ADD     (sim_sfr[SIM_SSP2ADD].byte)
+#define SSP2BUF     (sim_sfr[SIM_SSP2BUF].byte)
+#define TXSTA1      (sim_sfr[SIM_TXSTA1].byte)
+#define RCSTA1      (sim_sfr[SIM_RCSTA1].byte)
+#define BAUDCON1    (sim_sfr[SIM_BAUDCON1].byte)
+#define SPBRG1      (sim_sfr[SIM_SPBRG1].byte)
+#define SPBRGH1     (sim_sfr[SIM_SPBRGH1].byte)
+#define TXREG1      (sim_sfr[SIM_TXREG1].byte)
+#define TMR1        sim_tmr1
+
+#define LATAbits    (sim_sfr[SIM_LATA].lata)
+#define LATBbits    (sim_sfr[SIM_LATB].latb)
+#define LATCbits    (sim_sfr[SIM_LATC].latc)
+#define TRISAbits   (sim_sfr[SIM_TRISA].trisa)
+#define TRISBbits   (sim_sfr[SIM_TRISB].trisb)
+#define TRISCbits   (sim_sfr[SIM_TRISC].trisc)
+#define ANSELAbits  (sim_sfr[SIM_ANSELA].ansela)
+#define ANSELBbits  (sim_sfr[SIM_ANSELB].anselb)
+#define ANSELCbits  (sim_sfr[SIM_ANSELC].anselc)
+#define PIR1bits    (sim_sfr[SIM_PIR1].pir1)
+#define PIE1bits    (sim_sfr[SIM_PIE1].pie1)
+#define PIR2bits    (sim_sfr[SIM_PIR2].pir2)
+#define PIE2bits    (sim_sfr[SIM_PIE2].pie2)
+#define PIR3bits    (sim_sfr[SIM_PIR3].pir3)
+#define PIE3bits    (sim_sfr[SIM_PIE3].pie3)
+#define PIR5bits    (sim_sfr[SIM_PIR5].pir5)
+#define OSCTUNEbits (sim_sfr[SIM_OSCTUNE].osctune)
+#define T1CONbits   (sim_sfr[SIM_T1CON].t1con)
+#define T2CONbits   (sim_sfr[SIM_T2CON].t2con)
+#define T3CONbits   (sim_sfr[SIM_T3CON].t3con)
+#define T4CONbits   (sim_sfr[SIM_T4CON].t4con)
+#define SSP1CON1bits (sim_sfr[SIM_SSP1CON1].sspcon1)
+#define SSP2CON1bits (sim_sfr[SIM_SSP2CON1].sspcon1)
+
+/* Polled registers : the firmware waits on these, so time passes */
+#define PORTA       (sim_poll(SIM_PORTA)->byte)
+#define PORTB       (sim_poll(SIM_PORTB)->byte)
+#define PORTC       (sim_poll(SIM_PORTC)->byte)
+#define PORTAbits   (sim_poll(SIM_PORTA)->porta)
+#define PORTBbits   (sim_poll(SIM_PORTB)->portb)
+#define PORTCbits   (sim_poll(SIM_PORTC)->portc)
+#define INTCONbits  (sim_poll(SIM_INTCON)->intcon)
+#define PIE5bits    (sim_poll(SIM_PIE5)->pie5)          /* TICK_IE, around every tick read */
+#define OSCCONbits  (sim_poll(SIM_OSCCON)->osccon)
+#define OSCCON2bits (sim_poll(SIM_OSCCON2)->osccon2)
+#define TMR2        (sim_poll(SIM_TMR2)->byte)
+#define TMR4        (sim_poll(SIM_TMR4)->byte)
+#define TMR3        (*sim_poll16(&sim_tmr3))
+#define EECON1      (sim_poll(SIM_EECON1)->byte)
+#define EECON1bits  (sim_poll(SIM_EECON1)->eecon1)
+#define EEDATA      (sim_poll(SIM_EEDATA)->byte)
+#define HLVDCONbits (sim_poll(SIM_HLVDCON)->hlvdcon)
+#define TXSTA1bits  (sim_poll(SIM_TXSTA1)->txsta1)
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SIM_XC_H */